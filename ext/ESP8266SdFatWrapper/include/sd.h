@@ -61,10 +61,29 @@ int sd_rmdir(const char* path);
 int sd_get_stat(int fd, ps2_fileio_stat_t* const ps2_fileio_stat);
 
 int sd_iterate_dir(int dir, int it);
+int sd_rewind_dir(int dir);
 size_t sd_get_name(int fd, char* name, size_t size);
 bool sd_is_dir(int fd);
 int sd_fd_is_open(int fd);
 
 uint64_t sd_filesize64(int fd);
 int sd_seek64(int fd, int64_t offset, int whence);
-uint64_t sd_tell64(int fd);
\ No newline at end of file
+uint64_t sd_tell64(int fd);
+
+int sd_preallocate(int fd, uint64_t length);
+
+/* raw sector access, bypassing the file layer: only for files occupying a single contiguous extent,
+ * switch the file to raw access with sd_raw_begin and stop writing it through the file layer; the next
+ * file read or write after sd_write_sectors drops the volume cache so it sees the new data */
+int sd_contiguous_range(int fd, uint32_t *first_sector, uint32_t *sector_count);
+int sd_raw_begin(int fd);
+int sd_read_sectors(uint32_t sector, void *buf, size_t count);
+int sd_write_sectors(uint32_t sector, const void *buf, size_t count);
+
+/* cooperative raw multi-block transfer: sd_xfer_start opens a multi-block read or write stream, or carries on
+ * with the open one if the request begins where it left off, and each sd_xfer_step then moves one sector so
+ * the caller gets control back in between; sd_xfer_step returns 1 while sectors are left, 0 once the request
+ * is done and -1 on error. The stream stays open for a following request until any other call ends it */
+int sd_xfer_start(uint32_t sector, void *buf, size_t count, bool write);
+int sd_xfer_step(void);
+void sd_xfer_stop(void);
@@ -21,6 +21,7 @@
 #include "SPI.h"
 #include <hardware/spi.h>
 #include <hardware/gpio.h>
+#include <hardware/dma.h>
 
 #ifdef USE_TINYUSB
 // For Serial when selecting TinyUSB.  Can't include in the core because Arduino IDE
@@ -40,6 +41,9 @@ SPIClassRP2040::SPIClassRP2040(spi_inst_t *spi, pin_size_t rx, pin_size_t cs, pi
     _TX = tx;
     _SCK = sck;
     _CS = cs;
+    _dmaTx = -1;
+    _dmaRx = -1;
+    _dmaEnabled = true;
 }
 
 inline spi_cpol_t SPIClassRP2040::cpol() {
@@ -130,9 +134,49 @@ uint16_t SPIClassRP2040::transfer16(uint16_t data) {
     return ret;
 }
 
+// Bulk MSB-first transfer through a paired TX/RX DMA channel, the CPU only waits for the RX side to drain.
+// A null txbuf clocks out 0xFF, a null rxbuf discards what comes back.
+void SPIClassRP2040::dmaTransfer(const uint8_t *txbuf, uint8_t *rxbuf, size_t count) {
+    static const uint8_t fill = 0xFF;
+    static uint8_t sink;
+
+    spi_set_format(_spi, 8, cpol(), cpha(), SPI_MSB_FIRST);
+
+    dma_channel_config c = dma_channel_get_default_config(_dmaTx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(_spi, true));
+    channel_config_set_read_increment(&c, txbuf != nullptr);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(_dmaTx, &c, &spi_get_hw(_spi)->dr, txbuf ? txbuf : &fill, count, false);
+
+    c = dma_channel_get_default_config(_dmaRx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(_spi, false));
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, rxbuf != nullptr);
+    dma_channel_configure(_dmaRx, &c, rxbuf ? rxbuf : &sink, &spi_get_hw(_spi)->dr, count, false);
+
+    // Start both together so the RX FIFO can never overflow
+    dma_start_channel_mask((1u << _dmaTx) | (1u << _dmaRx));
+    dma_channel_wait_for_finish_blocking(_dmaRx);
+}
+
+inline bool SPIClassRP2040::useDma(size_t count) {
+    return _dmaEnabled && (_dmaTx >= 0) && (count >= SPI_DMA_MIN) && (_spis.getBitOrder() == MSBFIRST);
+}
+
 void SPIClassRP2040::transfer(void *buf, size_t count) {
+    if (!_initted) {
+        return;
+    }
+
     DEBUGSPI("SPI::transfer(%p, %d)\n", buf, count);
     uint8_t *buff = reinterpret_cast<uint8_t *>(buf);
+    if (useDma(count)) {
+        // RX byte n only arrives after TX byte n left, so the buffer can be both source and destination
+        dmaTransfer(buff, buff, count);
+        return;
+    }
     for (size_t i = 0; i < count; i++) {
         *buff = transfer(*buff);
         *buff = (_spis.getBitOrder() == MSBFIRST) ? *buff : reverseByte(*buff);
@@ -150,6 +194,11 @@ void SPIClassRP2040::transfer(const void *txbuf, void *rxbuf, size_t count) {
     const uint8_t *txbuff = reinterpret_cast<const uint8_t *>(txbuf);
     uint8_t *rxbuff = reinterpret_cast<uint8_t *>(rxbuf);
 
+    if (useDma(count)) {
+        dmaTransfer(txbuff, rxbuff, count);
+        return;
+    }
+
     // MSB version is easy!
     if (_spis.getBitOrder() == MSBFIRST) {
         spi_set_format(_spi, 8, cpol(), cpha(), SPI_MSB_FIRST);
@@ -177,6 +226,10 @@ void SPIClassRP2040::transfer(const void *txbuf, void *rxbuf, size_t count) {
     DEBUGSPI("SPI::transfer completed\n");
 }
 
+void SPIClassRP2040::setDma(bool enable) {
+    _dmaEnabled = enable;
+}
+
 void SPIClassRP2040::beginTransaction(SPISettings settings) {
     DEBUGSPI("SPI::beginTransaction(clk=%d, bo=%s\n", _spis.getClockFreq(), (_spis.getBitOrder() == MSBFIRST) ? "MSB" : "LSB");
     if (_initted && settings == _spis) {
@@ -274,6 +327,20 @@ void SPIClassRP2040::begin(bool hwCS) {
     }
     gpio_set_function(_SCK, GPIO_FUNC_SPI);
     gpio_set_function(_TX, GPIO_FUNC_SPI);
+    // Bulk transfers fall back to the FIFO loops if no DMA channels are left
+    if (_dmaTx < 0) {
+        _dmaTx = dma_claim_unused_channel(false);
+        _dmaRx = dma_claim_unused_channel(false);
+        if (_dmaTx < 0 || _dmaRx < 0) {
+            if (_dmaTx >= 0) {
+                dma_channel_unclaim(_dmaTx);
+            }
+            if (_dmaRx >= 0) {
+                dma_channel_unclaim(_dmaRx);
+            }
+            _dmaTx = _dmaRx = -1;
+        }
+    }
     // Give a default config in case user doesn't use beginTransaction
     beginTransaction(_spis);
 }
@@ -285,6 +352,11 @@ void SPIClassRP2040::end() {
         _initted = false;
         spi_deinit(_spi);
     }
+    if (_dmaTx >= 0) {
+        dma_channel_unclaim(_dmaTx);
+        dma_channel_unclaim(_dmaRx);
+        _dmaTx = _dmaRx = -1;
+    }
     gpio_set_function(_RX, GPIO_FUNC_SIO);
     if (_hwCS) {
         gpio_set_function(_CS, GPIO_FUNC_SIO);
@@ -8,6 +8,11 @@
 
 #define DEBUGSPI(...) do { } while(0)
 
+// Shortest transfer worth setting up DMA for, SD commands and tokens stay on the FIFO path
+#ifndef SPI_DMA_MIN
+#define SPI_DMA_MIN 32
+#endif
+
 typedef enum {
   SPI_MODE0 = 0,
   SPI_MODE1 = 1,
@@ -145,6 +150,9 @@ public:
     void begin(bool hwCS);
     void end() override;
 
+    // Bulk transfers take the FIFO path while disabled, to compare the two
+    void setDma(bool enable);
+
     // Deprecated - do not use!
     void setBitOrder(BitOrder order) __attribute__((deprecated));
     void setDataMode(uint8_t uc_mode) __attribute__((deprecated));
@@ -166,6 +174,8 @@ private:
     uint8_t reverseByte(uint8_t b);
     uint16_t reverse16Bit(uint16_t w);
     void adjustBuffer(const void *s, void *d, size_t cnt, bool by16);
+    bool useDma(size_t count);
+    void dmaTransfer(const uint8_t *txbuf, uint8_t *rxbuf, size_t count);
 
     spi_inst_t *_spi;
     SPISettings _spis;
@@ -173,6 +183,8 @@ private:
     bool _hwCS;
     bool _running; // SPI port active
     bool _initted; // Transaction begun
+    int _dmaTx, _dmaRx; // Bulk transfer channels, -1 if none
+    bool _dmaEnabled;
 };
 
 typedef SPIClassRP2040 SPIClass;
@@ -4,6 +4,7 @@
 #include "SPI.h"
 
 #include "hardware/gpio.h"
+#include "hardware/timer.h"
 
 extern "C" {
 #include "debug.h"
@@ -25,6 +26,60 @@ extern "C" {
 static SdFat sd;
 static File files[NUM_FILES + 1];
 static bool initialized = false;
+/* sectors were written raw since the volume cache was last dropped */
+static bool raw_written = false;
+
+/* file data goes through the volume cache, which may hold a sector written raw since it was read; directory and
+ * FAT sectors never belong to a file accessed raw, so only file reads and writes drop the cache, once */
+static void raw_cache_drop(void) {
+    if (raw_written) {
+        raw_written = false;
+        sd.cacheClear();
+    }
+}
+
+/* multi-block stream left open by sd_xfer_start, see sd.h */
+static struct {
+    bool active;
+    bool write;
+    uint32_t sector;  // next sector of the stream
+    uint8_t *buf;
+    size_t count;     // sectors left of the current request
+} xfer;
+
+/* the card takes no other command while a stream is open, so every other access ends it first */
+static void xfer_close(void) {
+    if (xfer.active) {
+        xfer.active = false;
+        if (xfer.write)
+            sd.card()->writeStop();
+        else
+            sd.card()->readStop();
+    }
+}
+
+#define BENCH_SECTORS 64
+
+/* sequential raw read speed of the card start, through the SPI DMA path and through the FIFO loops */
+static void sd_run_bench(void) {
+    static uint8_t buf[512];
+    float speed[2];
+
+    for (int dma = 0; dma < 2; ++dma) {
+        SD_PERIPH.setDma(dma);
+        uint64_t start = time_us_64();
+        for (uint32_t sector = 0; sector < BENCH_SECTORS; ++sector) {
+            if (!sd.card()->readSectors(sector, buf, 1)) {
+                SD_PERIPH.setDma(true);
+                return;
+            }
+        }
+        speed[dma] = 1000000.0f * BENCH_SECTORS * sizeof(buf) / (time_us_64() - start) / 1024;
+    }
+    sd.card()->syncDevice();
+
+    printf("SD read speed -- FIFO %.2f kB/s -- DMA %.2f kB/s\n", speed[0], speed[1]);
+}
 
 extern "C" void sd_init() {
     if (!initialized) {
@@ -47,6 +102,7 @@ extern "C" void sd_init() {
                 fatal(ERR_SDCARD, "failed to mount the card\nUNKNOWN");
             }
         }
+        sd_run_bench();
         initialized = true;
     }
 }
@@ -61,6 +117,7 @@ void sdCsWrite(SdCsPin_t pin, bool level) {
 }
 
 extern "C" int sd_open(const char *path, int oflag) {
+    xfer_close();
     size_t fd;
 
     if (!sd_exists(path) && (oflag & O_CREAT) == 0) {
@@ -88,31 +145,38 @@ extern "C" int sd_open(const char *path, int oflag) {
 #define CHECK_FD_VOID(fd) if (fd >= NUM_FILES || !files[fd].isOpen()) return;
 
 extern "C" int sd_close(int fd) {
+    xfer_close();
     CHECK_FD(fd);
 
     return files[fd].close() != true;
 }
 
 extern "C" void sd_flush(int fd) {
+    xfer_close();
     CHECK_FD_VOID(fd);
 
     files[fd].flush();
 }
 
 extern "C" int sd_read(int fd, void *buf, size_t count) {
+    xfer_close();
     CHECK_FD(fd);
 
+    raw_cache_drop();
 
     return files[fd].read(buf, count);
 }
 
 extern "C" int sd_write(int fd, void *buf, size_t count) {
+    xfer_close();
     CHECK_FD(fd);
 
+    raw_cache_drop();
     return files[fd].write(buf, count);
 }
 
 extern "C" int sd_seek(int fd, int32_t offset, int whence) {
+    xfer_close();
     CHECK_FD(fd);
 
     if (whence == 0) {
@@ -133,6 +197,7 @@ extern "C" uint32_t sd_tell(int fd) {
 }
 
 extern "C" int sd_mkdir(const char *path) {
+    xfer_close();
     if (sd_exists(path)) {
         /* return 0 if the directory already exists */
         return 0;
@@ -143,6 +208,7 @@ extern "C" int sd_mkdir(const char *path) {
 }
 
 extern "C" int sd_exists(const char *path) {
+    xfer_close();
     return sd.exists(path);
 }
 
@@ -152,16 +218,19 @@ extern "C" int sd_filesize(int fd) {
 }
 
 extern "C" int sd_rmdir(const char* path) {
+    xfer_close();
     /* return 1 on error */
     return sd.rmdir(path) != true;
 }
 
 extern "C" int sd_remove(const char* path) {
+    xfer_close();
     /* return 1 on error */
     return sd.remove(path) != true;
 }
 
 extern "C" int sd_iterate_dir(int dir, int it) {
+    xfer_close();
     if (it == -1) {
         for (it = 0; it < NUM_FILES; ++it)
             if (!files[it].isOpen())
@@ -173,7 +242,15 @@ extern "C" int sd_iterate_dir(int dir, int it) {
     return it;
 }
 
+extern "C" int sd_rewind_dir(int dir) {
+    xfer_close();
+    CHECK_FD(dir);
+    files[dir].rewind();
+    return 0;
+}
+
 extern "C" size_t sd_get_name(int fd, char* name, size_t size) {
+    xfer_close();
     return files[fd].getName(name, size);
 }
 
@@ -182,6 +259,7 @@ extern "C" bool sd_is_dir(int fd) {
 }
 
 extern "C" int sd_getStat(int fd, sd_file_stat_t* const sd_stat) {
+    xfer_close();
     files[fd].getAccessDateTime(&sd_stat->adate, &sd_stat->atime);
     files[fd].getCreateDateTime(&sd_stat->cdate, &sd_stat->ctime);
     files[fd].getModifyDateTime(&sd_stat->mdate, &sd_stat->mtime);
@@ -209,6 +287,7 @@ extern "C" void mapTime(const uint16_t date, const uint16_t time, uint8_t* const
 
 //Get stat and convert to format fileio expects
 extern "C" int sd_get_stat(int fd, ps2_fileio_stat_t* const ps2_fileio_stat) {
+    xfer_close();
     CHECK_FD(fd);
 
     uint16_t date, time;
@@ -262,7 +341,94 @@ extern "C" uint64_t sd_tell64(int fd) {
     return (uint64_t)files[fd].curPosition();
 }
 
+extern "C" int sd_preallocate(int fd, uint64_t length) {
+    xfer_close();
+    CHECK_FD(fd);
+
+    /* return 1 on error, the file is then grown cluster by cluster as usual */
+    return files[fd].preAllocate(length) != true;
+}
+
+extern "C" int sd_contiguous_range(int fd, uint32_t *first_sector, uint32_t *sector_count) {
+    xfer_close();
+    CHECK_FD(fd);
+    uint32_t bgn, end;
+
+    /* return 1 if the file is fragmented */
+    if (!files[fd].contiguousRange(&bgn, &end))
+        return 1;
+
+    *first_sector = bgn;
+    *sector_count = end - bgn + 1;
+    return 0;
+}
+
+extern "C" int sd_raw_begin(int fd) {
+    xfer_close();
+    CHECK_FD(fd);
+
+    /* return 1 on error; nothing of the file may be left pending in the cache, or cached from before */
+    if (!files[fd].sync() || !sd.cacheClear())
+        return 1;
+    raw_written = false;
+    return 0;
+}
+
+extern "C" int sd_read_sectors(uint32_t sector, void *buf, size_t count) {
+    xfer_close();
+    /* return 1 on error */
+    return sd.card()->readSectors(sector, (uint8_t*)buf, count) != true;
+}
+
+extern "C" int sd_write_sectors(uint32_t sector, const void *buf, size_t count) {
+    xfer_close();
+    raw_written = true;
+    /* return 1 on error */
+    return sd.card()->writeSectors(sector, (const uint8_t*)buf, count) != true;
+}
+
+extern "C" int sd_xfer_start(uint32_t sector, void *buf, size_t count, bool write) {
+    /* a stream left open right where this request begins carries on without a new command */
+    if (!xfer.active || (xfer.write != write) || (xfer.sector != sector)) {
+        xfer_close();
+        /* also ends a stream SdFat itself keeps open on a dedicated SPI bus */
+        if (!sd.card()->syncDevice())
+            return 1;
+        if (!(write ? sd.card()->writeStart(sector) : sd.card()->readStart(sector)))
+            return 1;
+        xfer.active = true;
+        xfer.write = write;
+        xfer.sector = sector;
+    }
+    if (write)
+        raw_written = true;
+    xfer.buf = (uint8_t*)buf;
+    xfer.count = count;
+    return 0;
+}
+
+extern "C" int sd_xfer_step(void) {
+    if (!xfer.active)
+        return -1;
+
+    if (xfer.count > 0) {
+        if (!(xfer.write ? sd.card()->writeData(xfer.buf) : sd.card()->readData(xfer.buf))) {
+            xfer_close();
+            return -1;
+        }
+        xfer.buf += 512;
+        xfer.sector++;
+        xfer.count--;
+    }
+    return xfer.count > 0;
+}
+
+extern "C" void sd_xfer_stop(void) {
+    xfer_close();
+}
+
 extern "C" int sd_seek64(int fd, int64_t offset, int whence) {
+    xfer_close();
     if (whence == 0) {
         return files[fd].seekSet((uint64_t)offset) != true;
     } else if (whence == 1) {
@@ -271,4 +437,4 @@ extern "C" int sd_seek64(int fd, int64_t offset, int whence) {
         return files[fd].seekEnd(offset) != true;
     }
     return 1;
-}
\ No newline at end of file
+}
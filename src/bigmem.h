@@ -6,6 +6,9 @@
 #else
     #define CACHE_SIZE 1024 * 128
 #endif
+
+#define MMCE_DIR_CACHE_SIZE (8 * 1024)
+
 typedef union {
     struct {
         uint16_t dirty_heap[1024];
@@ -15,6 +18,7 @@ typedef union {
     struct {
         uint16_t dirty_heap[8 * 1024 * 1024 / 512];
         uint8_t dirty_map[8 * 1024 * 1024 / 512 / 8];
+        uint8_t dir_cache[MMCE_DIR_CACHE_SIZE]; /* MMCE FS directory snapshot */
     } ps2;
     #endif
 
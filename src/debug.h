@@ -18,6 +18,7 @@
 #define LOG_LEVEL_CARD_CONF  4
 #define LOG_LEVEL_PS1_MC     2
 #define LOG_LEVEL_PS1_CM     2
+#define LOG_LEVEL_PS1_DIRTY  2
 #define LOG_LEVEL_PS1_MMCE   2
 
 #define LOG_ERROR 1
@@ -30,7 +30,33 @@
 
 #define CARD_SIZE (128 * 1024)
 #define BLOCK_SIZE 128
-static uint8_t flushbuf[BLOCK_SIZE];
+/* cards are created and loaded in chunks, ping-ponged so SD access overlaps the PSRAM transfer of the previous one */
+#define LOAD_CHUNK_SIZE 4096
+#if WITH_PSRAM
+#define LOAD_BUFFERS 2
+#else
+#define LOAD_BUFFERS 1
+#endif
+static uint8_t loadbuf[LOAD_BUFFERS][LOAD_CHUNK_SIZE];
+#if WITH_PSRAM
+static volatile bool load_dma_pending;
+
+static void load_dma_done(void) {
+    load_dma_pending = false;
+}
+
+static void wait_load_dma(void) {
+    while (load_dma_pending) {
+        tight_loop_contents();
+    }
+}
+
+static void start_load_dma(size_t pos, uint8_t *buf) {
+    wait_load_dma();
+    load_dma_pending = true;
+    psram_write_dma(pos, buf, LOAD_CHUNK_SIZE, load_dma_done);
+}
+#endif
 static int fd = -1;
 
 #define IDX_MIN 1
@@ -133,6 +159,20 @@ int ps1_cardman_read_sector(int sector, void *buf128) {
     return 0;
 }
 
+/* reads count consecutive sectors with a single seek */
+int ps1_cardman_read_sectors(int sector, int count, void *buf) {
+    if (fd < 0)
+        return -1;
+
+    if (sd_seek(fd, sector * BLOCK_SIZE, SEEK_SET) != 0)
+        return -2;
+
+    if (sd_read(fd, buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
+        return -3;
+
+    return 0;
+}
+
 int ps1_cardman_write_sector(int sector, void *buf512) {
     if (fd < 0)
         return -1;
@@ -146,6 +186,20 @@ int ps1_cardman_write_sector(int sector, void *buf512) {
     return 0;
 }
 
+/* writes count consecutive sectors with a single seek */
+int ps1_cardman_write_sectors(int sector, int count, void *buf) {
+    if (fd < 0)
+        return -1;
+
+    if (sd_seek(fd, sector * BLOCK_SIZE, SEEK_SET) != 0)
+        return -1;
+
+    if (sd_write(fd, buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
+        return -1;
+
+    return 0;
+}
+
 void ps1_cardman_flush(void) {
     if (fd >= 0)
         sd_flush(fd);
@@ -171,6 +225,11 @@ static void genblock(size_t pos, void *buf) {
         memcpy(buf, &ps1_empty_card[pos], BLOCK_SIZE);
 }
 
+static void genchunk(size_t pos, uint8_t *buf) {
+    for (size_t off = 0; off < LOAD_CHUNK_SIZE; off += BLOCK_SIZE)
+        genblock(pos + off, &buf[off]);
+}
+
 void ps1_cardman_open(void) {
     char path[96];
     sd_init();
@@ -219,17 +278,19 @@ void ps1_cardman_open(void) {
         log(LOG_INFO, "create new image at %s... ", path);
         uint64_t cardprog_start = time_us_64();
 
-        for (size_t pos = 0; pos < CARD_SIZE; pos += BLOCK_SIZE) {
-            genblock(pos, flushbuf);
+        int buf = 0;
+        for (size_t pos = 0; pos < CARD_SIZE; pos += LOAD_CHUNK_SIZE) {
+            genchunk(pos, loadbuf[buf]);
 #if WITH_PSRAM
-            psram_write_dma(pos, flushbuf, BLOCK_SIZE, NULL);
+            start_load_dma(pos, loadbuf[buf]);
 #endif
-            if (sd_write(fd, flushbuf, BLOCK_SIZE) != BLOCK_SIZE)
+            if (sd_write(fd, loadbuf[buf], LOAD_CHUNK_SIZE) != LOAD_CHUNK_SIZE)
                 fatal(ERR_CARDMAN, "cannot init memcard");
+            buf = (buf + 1) % LOAD_BUFFERS;
+        }
 #if WITH_PSRAM
-            psram_wait_for_dma();
+        wait_load_dma();
 #endif
-        }
         sd_flush(fd);
 
         ps1_mc_data_interface_card_changed();
@@ -250,14 +311,18 @@ void ps1_cardman_open(void) {
         log(LOG_INFO, "reading card.... ");
         uint64_t cardprog_start = time_us_64();
 #if WITH_PSRAM
-        for (size_t pos = 0; pos < CARD_SIZE; pos += BLOCK_SIZE) {
-            if (sd_read(fd, flushbuf, BLOCK_SIZE) != BLOCK_SIZE)
+        int buf = 0;
+        for (size_t pos = 0; pos < CARD_SIZE; pos += LOAD_CHUNK_SIZE) {
+            /* the previous chunk is still being transferred to PSRAM from the other buffer */
+            if (sd_read(fd, loadbuf[buf], LOAD_CHUNK_SIZE) != LOAD_CHUNK_SIZE)
                 fatal(ERR_CARDMAN, "cannot read memcard");
 
-            psram_write_dma(pos, flushbuf, BLOCK_SIZE, NULL);
-            psram_wait_for_dma();
+            start_load_dma(pos, loadbuf[buf]);
+            buf = (buf + 1) % LOAD_BUFFERS;
         }
+        wait_load_dma();
 #endif
+        /* without PSRAM the whole card is read into cache by the data interface */
         ps1_mc_data_interface_card_changed();
         uint64_t end = time_us_64();
         log(LOG_INFO, "OK!\n");
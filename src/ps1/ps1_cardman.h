@@ -14,7 +14,9 @@ typedef enum {
 
 void ps1_cardman_init(void);
 int ps1_cardman_read_sector(int sector, void *buf128);
+int ps1_cardman_read_sectors(int sector, int count, void *buf);
 int ps1_cardman_write_sector(int sector, void *buf512);
+int ps1_cardman_write_sectors(int sector, int count, void *buf);
 void ps1_cardman_flush(void);
 void ps1_cardman_open(void);
 bool ps1_cardman_needs_update(void);
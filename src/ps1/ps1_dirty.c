@@ -1,6 +1,7 @@
 #include "ps1_dirty.h"
 #include "ps1_cardman.h"
 #include "ps1_mc_data_interface.h"
+#include "debug.h"
 #ifdef WITH_PSRAM
 #include <psram/psram.h>
 #endif
@@ -12,6 +13,17 @@
 #include <stdio.h>
 #include <string.h>
 
+#if LOG_LEVEL_PS1_DIRTY == 0
+    #define log(x...)
+#else
+    #define log(level, fmt, x...) LOG_PRINT(LOG_LEVEL_PS1_DIRTY, level, fmt, ##x)
+#endif
+
+/* frames are written back as whole, aligned SD blocks */
+#define FLUSH_BLOCK_SIZE    512
+#define FRAMES_PER_BLOCK    ( FLUSH_BLOCK_SIZE / PS1_PAGE_SIZE )
+#define FLUSH_RUN_BLOCKS    4
+
 spin_lock_t *ps1_dirty_spin_lock;
 volatile uint32_t ps1_dirty_lockout;
 int ps1_dirty_activity;
@@ -78,8 +90,29 @@ int ps1_dirty_get_marked(void) {
     return ret;
 }
 
+/* pops every dirty frame of the block holding the lowest one, and of the dirty blocks directly after it */
+static int ps1_dirty_get_run(int *first, int max_blocks) {
+    int sector = ps1_dirty_get_marked();
+    if (sector == -1)
+        return 0;
+
+    int end;
+    *first = sector - (sector % FRAMES_PER_BLOCK);
+    end = *first + FRAMES_PER_BLOCK;
+    while (num_dirty > 0) {
+        if (dirty_heap[0] >= end) {
+            if ((dirty_heap[0] >= end + FRAMES_PER_BLOCK) || ((end - *first) / FRAMES_PER_BLOCK >= max_blocks))
+                break;
+            end += FRAMES_PER_BLOCK;
+        }
+        ps1_dirty_get_marked();
+    }
+
+    return end - *first;
+}
+
 void ps1_dirty_task(void) {
-    static uint8_t flushbuf[128];
+    static uint8_t flushbuf[FLUSH_RUN_BLOCKS * FLUSH_BLOCK_SIZE];
 
     int num_after = 0;
     int hit = 0;
@@ -91,33 +124,40 @@ void ps1_dirty_task(void) {
         if ((time_us_64() - start) > 100 * 1000)
             break;
 
+        int first;
         ps1_dirty_lock();
-        int sector = ps1_dirty_get_marked();
+        int count = ps1_dirty_get_run(&first, FLUSH_RUN_BLOCKS);
         num_after = num_dirty;
-        if (sector == -1) {
-            ps1_dirty_unlock();
+#if !WITH_PSRAM
+        if (count > 0)
+            memcpy(flushbuf, ps1_mc_data_interface_get_page(first), count * PS1_PAGE_SIZE);
+#endif
+        ps1_dirty_unlock();
+        if (count == 0)
             break;
-        }
+
 #if WITH_PSRAM
-        psram_read_dma(sector * 128, flushbuf, 128, NULL);
-        psram_wait_for_dma();
-#else
-        uint8_t* page = ps1_mc_data_interface_get_page(sector);
-        memcpy(flushbuf, page, PS1_PAGE_SIZE);
+        /* one block per lock so core1 is not held off by the whole run */
+        for (int i = 0; i < count; i += FRAMES_PER_BLOCK) {
+            ps1_dirty_lock();
+            psram_read_dma((first + i) * PS1_PAGE_SIZE, &flushbuf[i * PS1_PAGE_SIZE], FLUSH_BLOCK_SIZE, NULL);
+            psram_wait_for_dma();
+            ps1_dirty_unlock();
+        }
 #endif
-        ps1_dirty_unlock();
 
-        ++hit;
+        hit += count;
 
-        printf("ps1 - write sector %d\n", sector);
+        log(LOG_TRACE, "ps1 - write sectors %d-%d\n", first, first + count - 1);
 
-        if (ps1_cardman_write_sector(sector, flushbuf) != 0) {
+        if (ps1_cardman_write_sectors(first, count, flushbuf) != 0) {
             // TODO: do something if we get too many errors?
             // for now lets push it back into the heap and try again later
-            printf("!! writing sector 0x%x failed\n", sector);
+            log(LOG_ERROR, "!! writing sectors 0x%x-0x%x failed\n", first, first + count - 1);
 
             ps1_dirty_lock();
-            ps1_dirty_mark(sector);
+            for (int i = 0; i < count; ++i)
+                ps1_dirty_mark(first + i);
             ps1_dirty_unlock();
         }
     }
@@ -127,7 +167,7 @@ void ps1_dirty_task(void) {
     uint64_t end = time_us_64();
 
     if (hit)
-        printf("remain to flush - %d - this one flushed %d and took %d ms\n", num_after, hit, (int)((end - start) / 1000));
+        log(LOG_INFO, "remain to flush - %d - this one flushed %d and took %d ms\n", num_after, hit, (int)((end - start) / 1000));
 
     if (num_after || !ps1_dirty_lockout_expired())
         ps1_dirty_activity = 1;
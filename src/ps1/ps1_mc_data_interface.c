@@ -30,18 +30,29 @@ static bool write_occured = false;
 
 
 #if WITH_PSRAM
+/*
+ * two page buffers: one is clocked out while the page after it is prefetched into the other,
+ * so long reads do not stall on the DMA at the start of every page
+ */
+static uint8_t* const pagebufs[2] = { &card[0], &card[PS1_PAGE_SIZE] };
+static int cur_buf;
+static volatile int dma_buf;
+static uint32_t stream_page;
+static volatile int32_t prefetch_page = -1;
+
 static void __time_critical_func(ps1_mc_data_interface_rx_done)() {
     dma_in_progress = false;
 
     ps1_dirty_unlock();
 }
 
-void __time_critical_func(ps1_mc_data_interface_start_dma)(uint32_t page) {
+static void __time_critical_func(ps1_mc_data_interface_start_dma)(uint32_t page, int buf) {
     ps1_dirty_lockout_renew();
     /* the spinlock will be unlocked by the DMA irq once all data is tx'd */
     ps1_dirty_lock();
+    dma_buf = buf;
     dma_in_progress = true;
-    psram_read_dma(page * PS1_PAGE_SIZE, card, PS1_PAGE_SIZE, ps1_mc_data_interface_rx_done);
+    psram_read_dma(page * PS1_PAGE_SIZE, pagebufs[buf], PS1_PAGE_SIZE, ps1_mc_data_interface_rx_done);
 }
 #endif
 
@@ -49,7 +60,14 @@ void __time_critical_func(ps1_mc_data_interface_start_dma)(uint32_t page) {
 
 void __time_critical_func(ps1_mc_data_interface_setup_read_page)(uint32_t page) {
 #if WITH_PSRAM
-        ps1_mc_data_interface_start_dma(page);
+    if ((int32_t)page == prefetch_page) {
+        /* may still be in flight, wait_for_byte covers that */
+        cur_buf ^= 1;
+    } else {
+        ps1_mc_data_interface_start_dma(page, cur_buf);
+    }
+    prefetch_page = -1;
+    stream_page = page;
 #endif
 }
 
@@ -57,7 +75,7 @@ uint8_t* __time_critical_func(ps1_mc_data_interface_get_page)(uint32_t page) {
     uint8_t* ret = NULL;
 
 #ifdef WITH_PSRAM
-    ret = card;
+    ret = pagebufs[cur_buf];
 #else
     ret = &card[page*PS1_PAGE_SIZE];
 #endif
@@ -65,41 +83,56 @@ uint8_t* __time_critical_func(ps1_mc_data_interface_get_page)(uint32_t page) {
     return ret;
 }
 
+/* frames are assembled here and only reach the card once their checksum has been checked */
+static uint8_t writebuf[PS1_PAGE_SIZE];
+
 void __time_critical_func(ps1_mc_data_interface_write_byte)(uint32_t address, uint8_t byte) {
-#if WITH_PSRAM
-    card[address%PS1_PAGE_SIZE] = byte;
+    writebuf[address % PS1_PAGE_SIZE] = byte;
+}
+
+void __time_critical_func(ps1_mc_data_interface_write_mc)(uint32_t page) {
+    if ((page + 1) * PS1_PAGE_SIZE > PS1_CARD_SIZE)
+        return;
+
     ps1_dirty_lockout_renew();
     ps1_dirty_lock();
-    psram_write_dma(address, &card[address%PS1_PAGE_SIZE], 1, NULL);
+#if WITH_PSRAM
+    psram_write_dma(page * PS1_PAGE_SIZE, writebuf, PS1_PAGE_SIZE, NULL);
     psram_wait_for_dma();
-
-    ps1_dirty_unlock();
 #else
-    card[address] = byte;
+    memcpy(&card[page * PS1_PAGE_SIZE], writebuf, PS1_PAGE_SIZE);
 #endif
-    write_occured = true;
-}
-
-void __time_critical_func(ps1_mc_data_interface_write_mc)(uint32_t page) {
     ps1_dirty_mark(page);
+    ps1_dirty_unlock();
+#if WITH_PSRAM
+    if ((int32_t)page == prefetch_page)
+        prefetch_page = -1;
+#endif
+    write_occured = true;
 }
 
 void __time_critical_func(ps1_mc_data_interface_wait_for_byte)(uint32_t offset) {
 #if WITH_PSRAM
-    while (dma_in_progress && psram_read_dma_remaining() >= (PS1_PAGE_SIZE - offset)) {};
+    while (dma_in_progress && (dma_buf == cur_buf) && psram_read_dma_remaining() >= (PS1_PAGE_SIZE - offset)) {};
+
+    /* current page is in, start on the next one */
+    if (!dma_in_progress && (prefetch_page < 0) && ((stream_page + 1) * PS1_PAGE_SIZE < PS1_CARD_SIZE)) {
+        prefetch_page = stream_page + 1;
+        ps1_mc_data_interface_start_dma(prefetch_page, cur_buf ^ 1);
+    }
 #endif
 }
 
 // Core 0
 
 void ps1_mc_data_interface_card_changed(void) {
-#if WITH_PSRAM != 1
+#if WITH_PSRAM
+    prefetch_page = -1;
+#else
     QPRINTF("Card changed\n");
 
-    for (int i = 0; i < 1024; i++) {
-        if (ps1_cardman_read_sector(i, &card[i*PS1_PAGE_SIZE]) < 0)
-            fatal(ERR_MC_DATA, "Sector %i not read!!!\n", i);
-    }
+    if (ps1_cardman_read_sectors(0, PS1_CARD_SIZE / PS1_PAGE_SIZE, card) < 0)
+        fatal(ERR_MC_DATA, "Card not read!!!\n");
 #endif
 }
 
@@ -137,6 +137,7 @@ void ps2_deinit(void) {
     while (ps2_mc_data_interface_write_occured())
         ps2_mc_data_interface_task();
     multicore_reset_core1();
+    ps2_mmceman_fs_flush();
     ps2_cardman_close();
     ps2_memory_card_unload();
 }
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "ps2_dirty.h"
 #endif
 #include "ps2_mc_internal.h"
+#include "ps2_mc_op_ring.h"
 #include "ps2_cardman.h"
 
 #include "debug.h"
@@ -32,7 +33,15 @@
 #define READ_CACHE      3
 
 #define PAGE_CACHE_SIZE ( WRITE_CACHE + ERASE_CACHE + READ_CACHE )
-#define MAX_READ_AHEAD  1
+
+/* SD mode read cache, set associative over the part of cache[] not used by the pages above */
+#define RCACHE_WAYS     4
+#define RCACHE_SETS     ( ( CACHE_SIZE / PS2_PAGE_SIZE - PAGE_CACHE_SIZE ) / RCACHE_WAYS )
+#define RCACHE_LINES    ( RCACHE_SETS * RCACHE_WAYS )
+/* sequential reads ramp read-ahead up to this many pages, bounded by what the read cache can hold */
+#define MAX_READ_AHEAD  8
+#define READ_AHEAD_CAP  ( RCACHE_LINES / 2 < MAX_READ_AHEAD ? RCACHE_LINES / 2 : MAX_READ_AHEAD )
+#define READ_AHEAD_EVAL 64
 
 #define MAX_TIME_SLICE  ( 5 * 1000 )
 
@@ -43,12 +52,19 @@
 
 static volatile bool dma_in_progress = false;
 
+enum { OP_TYPE_READ, OP_TYPE_WRITE, OP_TYPE_ERASE, OP_TYPE_PREFETCH, OP_TYPE_OTHER, OP_TYPE_COUNT };
+
+typedef struct {
+    volatile ps2_mcdi_page_t* page;
+    int type;
+    uint32_t prefetch_page;     // OP_TYPE_PREFETCH only, read straight into the read cache
+    uint32_t prefetch_gen;
+} ps2_mcdi_op_t;
+
 static volatile ps2_mcdi_page_t      writepages[WRITE_CACHE + ERASE_CACHE];
 static volatile ps2_mcdi_page_t      readpages[READ_CACHE];
-static volatile ps2_mcdi_page_t*     ops[PAGE_CACHE_SIZE];
-static volatile bool                 queue_full = false;
-static volatile int                  ops_head = 0;
-static volatile int                  ops_tail = 0;
+static volatile ps2_mcdi_op_t        ops[PAGE_CACHE_SIZE];
+static ps2_mc_op_ring_t              ops_ring;
 static volatile ps2_mcdi_page_t*     curr_read;
 static volatile ps2_mcdi_page_t*     readahead_read;
 static volatile ps2_mcdi_page_t*     c0_read;
@@ -58,62 +74,102 @@ static volatile bool                 busy_cycle;
 static volatile bool                 delay_reuired;
 static critical_section_t            crit;
 
-static volatile uint8_t erase_count = 0;
-static volatile uint8_t write_count = 0;
-static volatile uint8_t read_count  = 0;
+/* per type op counts, pushed is only written by core1 and popped only by core0 */
+static volatile uint32_t ops_pushed[OP_TYPE_COUNT];
+static volatile uint32_t ops_popped[OP_TYPE_COUNT];
+
+#define read_count  (ops_pushed[OP_TYPE_READ] - ops_popped[OP_TYPE_READ])
+#define write_count (ops_pushed[OP_TYPE_WRITE] - ops_popped[OP_TYPE_WRITE])
+#define erase_count (ops_pushed[OP_TYPE_ERASE] - ops_popped[OP_TYPE_ERASE])
+
+typedef struct {
+    uint32_t page;
+    uint32_t last_use;
+    bool valid;
+    bool prefetched;    // filled by read-ahead and not yet used
+    uint8_t* data;
+} ps2_mcdi_rcache_line_t;
+
+static ps2_mcdi_rcache_line_t rcache[RCACHE_LINES];
+static uint32_t rcache_tick;
+static volatile uint32_t rcache_hits;
+static volatile uint32_t rcache_misses;
+static volatile uint32_t rcache_write_gen;  // bumped by every write, stale prefetches are dropped
+
+/* core1 sequential access detection */
+static uint32_t ra_last_page;
+static uint32_t ra_depth = 1;
+static uint32_t ra_cap = READ_AHEAD_CAP;
+static uint32_t ra_next_page;               // first page not yet requested by read-ahead
+static volatile uint32_t ra_issued;
+static volatile uint32_t ra_used;
+static uint32_t ra_eval_issued, ra_eval_used;
+
+/*
+ * core0 SD mode write combining: erases are kept as 0xFF tombstones and the page writes that follow
+ * land on top of them, so one erase block goes to the card as a few multi-sector writes
+ */
+#define WC_PAGES        ERASE_SECTORS
+
+static uint8_t  wc_buf[WC_PAGES * PS2_PAGE_SIZE];
+static uint32_t wc_base;
+static uint32_t wc_pending;     // pages of the window not yet on the card
+static uint32_t wc_written;     // pages written by the game, for the history tracker
 
 static void ps2_mc_data_interface_invalidate_read(void);
+static void ps2_mc_data_interface_invalidate_read_range(uint32_t page, uint32_t count);
 
 
-static inline void __time_critical_func(push_op)(volatile ps2_mcdi_page_t* op) {
-    while (queue_full) {log(LOG_INFO, "_");};
-    critical_section_enter_blocking(&crit);
-    switch (op->page_state) {
+/* ops is a single producer (core1) / single consumer (core0) ring, see ps2_mc_op_ring.h */
+static inline int __time_critical_func(op_type)(int page_state) {
+    switch (page_state) {
         case PAGE_READ_REQ:
         case PAGE_READ_AHEAD_REQ:
-            read_count++;
-            break;
+            return OP_TYPE_READ;
         case PAGE_WRITE_REQ:
-            write_count++;
-            break;
+            return OP_TYPE_WRITE;
         case PAGE_ERASE_REQ:
-            erase_count++;
-            break;
+            return OP_TYPE_ERASE;
         default:
-        break;
+            return OP_TYPE_OTHER;
     }
-    ops[ops_head] = op;
-    ops_head = ( ops_head + 1 ) % PAGE_CACHE_SIZE;
-    queue_full = (ops_head == ops_tail);
+}
+
+static inline int __time_critical_func(op_fill_status)(void) {
+    return (int)ps2_mc_op_ring_fill(&ops_ring, PAGE_CACHE_SIZE);
+}
+
+static inline void __time_critical_func(push_entry)(volatile ps2_mcdi_page_t* op, int type, uint32_t prefetch_page) {
+    int slot;
+
+    while ((slot = ps2_mc_op_ring_push_slot(&ops_ring, PAGE_CACHE_SIZE)) < 0) {tight_loop_contents();};
+
+    ops[slot].page = op;
+    ops[slot].type = type;
+    ops[slot].prefetch_page = prefetch_page;
+    ops[slot].prefetch_gen = rcache_write_gen;
+    ops_pushed[type]++;
+    ps2_mc_op_ring_push_commit(&ops_ring, PAGE_CACHE_SIZE);
     delay_reuired = true;
-    critical_section_exit(&crit);
 }
 
-static inline volatile ps2_mcdi_page_t* __time_critical_func(pop_op)(void) {
-    critical_section_enter_blocking(&crit);
-    volatile ps2_mcdi_page_t* ptr = ops[ops_tail];
-        switch (ptr->page_state) {
-        case PAGE_READ_REQ:
-        case PAGE_READ_AHEAD_REQ:
-            read_count--;
-            break;
-        case PAGE_WRITE_REQ:
-            write_count--;
-            break;
-        case PAGE_ERASE_REQ:
-            erase_count--;
-            break;
-        default:
-        break;
-    }
-    ops_tail = (ops_tail + 1) % PAGE_CACHE_SIZE;
-    queue_full = false;
-    critical_section_exit(&crit);
-    return ptr;
+static inline void __time_critical_func(push_op)(volatile ps2_mcdi_page_t* op) {
+    push_entry(op, op_type(op->page_state), 0);
 }
 
-static inline int __time_critical_func(op_fill_status)(void) {
-    return (ops_head - ops_tail + PAGE_CACHE_SIZE) % PAGE_CACHE_SIZE;
+static inline ps2_mcdi_op_t __time_critical_func(pop_op)(void) {
+    /* callers check op_fill_status() first */
+    int slot = ps2_mc_op_ring_pop_slot(&ops_ring, PAGE_CACHE_SIZE);
+    ps2_mcdi_op_t op;
+
+    op.page = ops[slot].page;
+    op.type = ops[slot].type;
+    op.prefetch_page = ops[slot].prefetch_page;
+    op.prefetch_gen = ops[slot].prefetch_gen;
+    ops_popped[op.type]++;
+    ps2_mc_op_ring_pop_commit(&ops_ring, PAGE_CACHE_SIZE);
+
+    return op;
 }
 
 static inline volatile ps2_mcdi_page_t* __time_critical_func(ps2_mc_data_interface_find_slot)(bool read) {
@@ -134,6 +190,71 @@ static inline volatile ps2_mcdi_page_t* __time_critical_func(ps2_mc_data_interfa
     return page;
 }
 
+/* all rcache_ helpers must be called from within crit */
+static inline ps2_mcdi_rcache_line_t* __time_critical_func(rcache_find)(uint32_t page) {
+    ps2_mcdi_rcache_line_t* set = &rcache[(page % RCACHE_SETS) * RCACHE_WAYS];
+
+    for (int i = 0; i < RCACHE_WAYS; i++)
+        if (set[i].valid && set[i].page == page)
+            return &set[i];
+    return NULL;
+}
+
+static bool __time_critical_func(rcache_lookup)(uint32_t page, uint8_t* buf) {
+    ps2_mcdi_rcache_line_t* line = (RCACHE_LINES > 0) ? rcache_find(page) : NULL;
+
+    if (!line) {
+        rcache_misses++;
+        return false;
+    }
+    line->last_use = ++rcache_tick;
+    memcpy(buf, line->data, PS2_PAGE_SIZE);
+    rcache_hits++;
+    if (line->prefetched) {
+        line->prefetched = false;
+        ra_used++;
+    }
+    return true;
+}
+
+static void __time_critical_func(rcache_insert)(uint32_t page, const uint8_t* buf, bool prefetched) {
+    if (RCACHE_LINES == 0)
+        return;
+
+    ps2_mcdi_rcache_line_t* set = &rcache[(page % RCACHE_SETS) * RCACHE_WAYS];
+    ps2_mcdi_rcache_line_t* line = rcache_find(page);
+
+    /* replace an unused way or the least recently used one */
+    for (int i = 0; !line && i < RCACHE_WAYS; i++)
+        if (!set[i].valid)
+            line = &set[i];
+    if (!line) {
+        line = &set[0];
+        for (int i = 1; i < RCACHE_WAYS; i++)
+            if (set[i].last_use < line->last_use)
+                line = &set[i];
+    }
+
+    line->page = page;
+    line->valid = true;
+    line->prefetched = prefetched;
+    line->last_use = ++rcache_tick;
+    memcpy(line->data, buf, PS2_PAGE_SIZE);
+}
+
+/* write-through, the SD write of the same page is queued behind any pending read of it */
+static void __time_critical_func(rcache_update)(uint32_t page, const uint8_t* buf) {
+    ps2_mcdi_rcache_line_t* line = (RCACHE_LINES > 0) ? rcache_find(page) : NULL;
+
+    rcache_write_gen++;
+    if (line) {
+        if (buf)
+            memcpy(line->data, buf, PS2_PAGE_SIZE);
+        else
+            memset(line->data, 0xFF, PS2_PAGE_SIZE);
+    }
+}
+
 static void ps2_mc_data_interface_set_page(volatile ps2_mcdi_page_t* page, uint32_t addr, int state) {
     critical_section_enter_blocking(&crit);
     page->page = addr;
@@ -142,6 +263,51 @@ static void ps2_mc_data_interface_set_page(volatile ps2_mcdi_page_t* page, uint3
 }
 
 
+static inline bool wc_holds(uint32_t page) {
+    return (page - wc_base < WC_PAGES) && (wc_pending & (1U << (page - wc_base)));
+}
+
+static void wc_flush(void) {
+    uint32_t i = 0;
+
+    while (i < WC_PAGES) {
+        if (!(wc_pending & (1U << i))) {
+            i++;
+            continue;
+        }
+        uint32_t start = i;
+        while ((i < WC_PAGES) && (wc_pending & (1U << i)))
+            i++;
+        log(LOG_INFO, "%s Writing %u pages at %u\n", __func__, i - start, wc_base + start);
+        ps2_cardman_write_sectors(wc_base + start, i - start, &wc_buf[start * PS2_PAGE_SIZE]);
+    }
+    for (i = 0; i < WC_PAGES; i++)
+        if (wc_written & (1U << i))
+            ps2_history_tracker_registerPageWrite(wc_base + i);
+    wc_pending = 0;
+    wc_written = 0;
+}
+
+static void wc_erase(uint32_t page) {
+    if (wc_pending && (page != wc_base))
+        wc_flush();
+
+    wc_base = page;
+    memset(wc_buf, 0xFF, sizeof(wc_buf));
+    wc_pending = (1U << WC_PAGES) - 1;
+}
+
+static void wc_write(uint32_t page, const volatile uint8_t* data) {
+    if (wc_pending && (page - wc_base >= WC_PAGES))
+        wc_flush();
+    if (!wc_pending)
+        wc_base = page;
+
+    memcpy(&wc_buf[(page - wc_base) * PS2_PAGE_SIZE], (const void*)data, PS2_PAGE_SIZE);
+    wc_pending |= 1U << (page - wc_base);
+    wc_written |= 1U << (page - wc_base);
+}
+
 #if WITH_PSRAM
 static void __time_critical_func(ps2_mc_data_interface_rx_done)() {
     dma_in_progress = false;
@@ -155,7 +321,7 @@ void __time_critical_func(ps2_mc_data_interface_start_dma)(volatile ps2_mcdi_pag
     psram_wait_for_dma();
     dma_in_progress = true;
     page_p->page_state = PAGE_DATA_AVAILABLE;
-    psram_read_dma(page_p->page * PS2_PAGE_SIZE, page_p->data, PS2_PAGE_SIZE, ps2_mc_data_interface_rx_done);
+    psram_read_dma(ps2_cardman_psram_base + page_p->page * PS2_PAGE_SIZE, page_p->data, PS2_PAGE_SIZE, ps2_mc_data_interface_rx_done);
     log(LOG_INFO, "%s start dma %zu\n", __func__, page_p->page);
     busy_cycle = true;
 }
@@ -163,6 +329,53 @@ void __time_critical_func(ps2_mc_data_interface_start_dma)(volatile ps2_mcdi_pag
 
 
 
+/* ramp read-ahead depth on sequential access, fall back to a single page on anything else */
+static void __time_critical_func(ps2_mc_data_interface_track_access)(uint32_t page) {
+    if (page == ra_last_page + 1) {
+        ra_depth = (ra_depth * 2 < ra_cap) ? ra_depth * 2 : ra_cap;
+    } else if (page != ra_last_page) {
+        ra_depth = 1;
+        ra_next_page = page + 2;
+    }
+    ra_last_page = page;
+
+    /* shrink the cap when prefetched pages are evicted unused, grow it back when they are consumed */
+    if (ra_issued - ra_eval_issued >= READ_AHEAD_EVAL) {
+        uint32_t issued = ra_issued - ra_eval_issued;
+        uint32_t used = ra_used - ra_eval_used;
+
+        if ((used * 2 < issued) && (ra_cap > 1))
+            ra_cap--;
+        else if ((used * 4 >= issued * 3) && (ra_cap < READ_AHEAD_CAP))
+            ra_cap++;
+        if (ra_depth > ra_cap)
+            ra_depth = ra_cap;
+        ra_eval_issued = ra_issued;
+        ra_eval_used = ra_used;
+    }
+}
+
+/* pages beyond the read-ahead slot go straight into the read cache */
+static void __time_critical_func(ps2_mc_data_interface_prefetch)(uint32_t page) {
+    uint32_t card_pages = ps2_cardman_get_card_size() / PS2_PAGE_SIZE;
+
+    if (ra_next_page < page + 2)
+        ra_next_page = page + 2;
+
+    while ((ra_next_page <= page + ra_depth) && (ra_next_page < card_pages)
+           && (op_fill_status() < PAGE_CACHE_SIZE / 2)) {
+        critical_section_enter_blocking(&crit);
+        bool cached = rcache_find(ra_next_page) != NULL;
+        critical_section_exit(&crit);
+
+        if (!cached) {
+            push_entry(NULL, OP_TYPE_PREFETCH, ra_next_page);
+            ra_issued++;
+        }
+        ra_next_page++;
+    }
+}
+
 void __time_critical_func(ps2_mc_data_interface_setup_read_page)(uint32_t page, bool readahead, bool wait) {
 
     if (page * PS2_PAGE_SIZE + PS2_PAGE_SIZE <= ps2_cardman_get_card_size()) {
@@ -173,7 +386,20 @@ void __time_critical_func(ps2_mc_data_interface_setup_read_page)(uint32_t page,
             if (get_core_num() == 0) {
                 if ((c0_read->page != page) || (c0_read->page_state == PAGE_EMPTY)) {
                     c0_read->page = page;
-                    ps2_cardman_read_sector(page, c0_read->data);
+                    critical_section_enter_blocking(&crit);
+                    bool hit = rcache_lookup(page, c0_read->data);
+                    uint32_t gen = rcache_write_gen;
+                    critical_section_exit(&crit);
+                    if (!hit && wc_holds(page)) {
+                        memcpy((void*)c0_read->data, &wc_buf[(page - wc_base) * PS2_PAGE_SIZE], PS2_PAGE_SIZE);
+                    } else if (!hit) {
+                        ps2_cardman_read_sector(page, c0_read->data);
+                        /* a write queued by core1 meanwhile may have hit this page */
+                        critical_section_enter_blocking(&crit);
+                        if (gen == rcache_write_gen)
+                            rcache_insert(page, c0_read->data, false);
+                        critical_section_exit(&crit);
+                    }
                     c0_read->page_state = PAGE_DATA_AVAILABLE;
                 }
             } else {
@@ -193,20 +419,29 @@ void __time_critical_func(ps2_mc_data_interface_setup_read_page)(uint32_t page,
                         log(LOG_TRACE, "%s setting up read for %u\n", __func__, page);
                         critical_section_enter_blocking(&crit);
                         curr_read->page = page;
-                        curr_read->page_state = PAGE_READ_REQ;
+                        bool hit = rcache_lookup(page, curr_read->data);
+                        curr_read->page_state = hit ? PAGE_DATA_AVAILABLE : PAGE_READ_REQ;
                         critical_section_exit(&crit);
-                        push_op(curr_read);
+                        if (!hit)
+                            push_op(curr_read);
                     }
                 }
+                if (readahead)
+                    ps2_mc_data_interface_track_access(page);
                 if (readahead && (readahead_read->page != page + 1)) {
                     log(LOG_TRACE, "%s setting up read ahead for %u\n", __func__, page);
                     critical_section_enter_blocking(&crit);
                     readahead_read->page = page + 1;
-                    readahead_read->page_state = PAGE_READ_AHEAD_REQ;
+                    bool hit = rcache_lookup(page + 1, readahead_read->data);
+                    readahead_read->page_state = hit ? PAGE_READ_AHEAD_AVAILABLE : PAGE_READ_AHEAD_REQ;
                     critical_section_exit(&crit);
-                    push_op(readahead_read);
+                    if (!hit)
+                        push_op(readahead_read);
                 }
 
+                if (readahead && (RCACHE_LINES > 0) && (ra_depth > 1))
+                    ps2_mc_data_interface_prefetch(page);
+
                 uint32_t timeout = 10000U;
                 while (wait
                         && (curr_read->page_state != PAGE_DATA_AVAILABLE)
@@ -279,10 +514,16 @@ volatile ps2_mcdi_page_t* __time_critical_func(ps2_mc_data_interface_get_page)(u
 void __time_critical_func(ps2_mc_data_interface_write_mc)(uint32_t page, void *buf) {
     if (page * PS2_PAGE_SIZE + PS2_PAGE_SIZE <= ps2_cardman_get_card_size()) {
         log(LOG_TRACE, "%s page %u\n", __func__, page);
-        ps2_mc_data_interface_invalidate_read();
 
         if (sdmode) {
+            ps2_mc_data_interface_invalidate_read_range(page, 1);
+            critical_section_enter_blocking(&crit);
+            rcache_update(page, buf);
+            critical_section_exit(&crit);
+
             if (get_core_num() == 0) {
+                if (wc_holds(page))
+                    wc_flush();
                 ps2_cardman_write_sector(page, buf);
                 ps2_cardman_flush();
             } else {
@@ -298,10 +539,11 @@ void __time_critical_func(ps2_mc_data_interface_write_mc)(uint32_t page, void *b
             log(LOG_INFO, "%s %u done\n", __func__, page);
         } else {
 #if WITH_PSRAM
+            ps2_mc_data_interface_invalidate_read();
             psram_wait_for_dma();
             ps2_dirty_lockout_renew();
             ps2_dirty_lock();
-            psram_write_dma(page * PS2_PAGE_SIZE, buf, PS2_PAGE_SIZE, NULL);
+            psram_write_dma(ps2_cardman_psram_base + page * PS2_PAGE_SIZE, buf, PS2_PAGE_SIZE, NULL);
             ps2_cardman_mark_sector_available(page);
             psram_wait_for_dma();
             ps2_dirty_mark(write_sector);
@@ -324,7 +566,7 @@ bool __time_critical_func(ps2_mc_data_interface_delay_required)(void) {
 }
 
 void ps2_mc_data_interface_flush(void) {
-    while ((sdmode && (op_fill_status() > 0))
+    while ((sdmode && ((op_fill_status() > 0) || wc_pending))
     #ifdef WITH_PSRAM
         || ps2_dirty_activity > 0
     #endif
@@ -337,8 +579,13 @@ void __time_critical_func(ps2_mc_data_interface_erase)(uint32_t page) {
     if ((page + ERASE_SECTORS) * PS2_PAGE_SIZE <= ps2_cardman_get_card_size()) {
         log(LOG_TRACE, "%s page %u\n", __func__, page);
 
-        ps2_mc_data_interface_invalidate_read();
         if (sdmode) {
+            ps2_mc_data_interface_invalidate_read_range(page, ERASE_SECTORS);
+            critical_section_enter_blocking(&crit);
+            for (int i = 0; i < ERASE_SECTORS; ++i)
+                rcache_update(page + i, NULL);
+            critical_section_exit(&crit);
+
             volatile ps2_mcdi_page_t* slot = ps2_mc_data_interface_find_slot(false);
 
             slot->page = page;
@@ -347,12 +594,13 @@ void __time_critical_func(ps2_mc_data_interface_erase)(uint32_t page) {
             push_op(slot);
         } else {
 #if WITH_PSRAM
+            ps2_mc_data_interface_invalidate_read();
             uint8_t erasebuff[PS2_PAGE_SIZE] = { 0 };
             memset(erasebuff, 0xFF, PS2_PAGE_SIZE);
             ps2_dirty_lockout_renew();
             ps2_dirty_lock();
             for (int i = 0; i < ERASE_SECTORS; ++i) {
-                psram_write_dma((page + i) * PS2_PAGE_SIZE, erasebuff, PS2_PAGE_SIZE, NULL);
+                psram_write_dma(ps2_cardman_psram_base + (page + i) * PS2_PAGE_SIZE, erasebuff, PS2_PAGE_SIZE, NULL);
                 psram_wait_for_dma();
                 ps2_cardman_mark_sector_available(page + i);
                 ps2_dirty_mark(page + i);
@@ -418,8 +666,34 @@ static void __time_critical_func (ps2_mc_data_interface_invalidate_read)(void) {
 
 }
 
+/* drop read pages within a range that is being written, instead of every cached read */
+static void __time_critical_func(ps2_mc_data_interface_invalidate_read_range)(uint32_t page, uint32_t count) {
+    for (int i = 0; i < READ_CACHE; i++) {
+        volatile ps2_mcdi_page_t* read_p = &readpages[i];
+
+        /* a read in flight would complete with the old data, core0 serves it before it gets to this write */
+        if (get_core_num() != 0)
+            while ((read_p->page - page < count)
+                   && ((read_p->page_state == PAGE_READ_REQ) || (read_p->page_state == PAGE_READ_AHEAD_REQ))) {tight_loop_contents();}
+
+        critical_section_enter_blocking(&crit);
+        if ((read_p->page - page < count)
+            && ((read_p->page_state == PAGE_DATA_AVAILABLE) || (read_p->page_state == PAGE_READ_AHEAD_AVAILABLE))) {
+            read_p->page = 0;
+            read_p->page_state = PAGE_EMPTY;
+            log(LOG_INFO, "%s Invalidated read %u\n", __func__, i);
+        }
+        critical_section_exit(&crit);
+    }
+}
+
 // Core 0
 void ps2_mc_data_interface_card_changed(void) {
+    /* SD mode statistics of the card being left */
+    if (sdmode)
+        log(LOG_INFO, "%s: read cache %u lines, %u hits, %u misses; read-ahead %u issued, %u used, depth cap %u\n", __func__,
+            RCACHE_LINES, rcache_hits, rcache_misses, ra_issued, ra_used, ra_cap);
+
     for(int i = 0; i < READ_CACHE; i++) {
         readpages[i].page_state = PAGE_EMPTY;
         readpages[i].page = 0;
@@ -431,16 +705,41 @@ void ps2_mc_data_interface_card_changed(void) {
         writepages[i].data = &cache[(READ_CACHE * PS2_PAGE_SIZE) + (i * PS2_PAGE_SIZE)];
     }
     for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
-        ops[i] = NULL;
+        ops[i].page = NULL;
+        ops[i].type = OP_TYPE_OTHER;
+    }
+    ps2_mc_op_ring_reset(&ops_ring);
+
+    for (int i = 0; i < RCACHE_LINES; i++) {
+        rcache[i].valid = false;
+        rcache[i].prefetched = false;
+        rcache[i].last_use = 0;
+        rcache[i].data = &cache[(PAGE_CACHE_SIZE * PS2_PAGE_SIZE) + (i * PS2_PAGE_SIZE)];
     }
+    rcache_tick = 0;
+    rcache_hits = 0;
+    rcache_misses = 0;
+    rcache_write_gen = 0;
+
+    wc_base = 0;
+    wc_pending = 0;
+    wc_written = 0;
+
+    ra_last_page = 0;
+    ra_depth = 1;
+    ra_cap = READ_AHEAD_CAP;
+    ra_next_page = 0;
+    ra_issued = ra_used = 0;
+    ra_eval_issued = ra_eval_used = 0;
 
     curr_read = &readpages[0];
     readahead_read = &readpages[1];
     c0_read = &readpages[2];
 
-    read_count = 0;
-    write_count = 0;
-    erase_count = 0;
+    for (int i = 0; i < OP_TYPE_COUNT; i++) {
+        ops_pushed[i] = 0;
+        ops_popped[i] = 0;
+    }
     write_occured = false;
     delay_reuired = false;
 
@@ -469,6 +768,63 @@ bool ps2_mc_data_interface_get_sdmode(void) {
     return sdmode;
 }
 
+static void ps2_mc_data_interface_complete_read(volatile ps2_mcdi_page_t* page_p, int req_state, int done_state) {
+    uint32_t page = page_p->page;
+    uint32_t gen;
+    bool hit = false;
+
+    /* a prefetch queued ahead of this read may already have brought the page in */
+    critical_section_enter_blocking(&crit);
+    gen = rcache_write_gen;
+    ps2_mcdi_rcache_line_t* line = (RCACHE_LINES > 0) ? rcache_find(page) : NULL;
+    if (wc_holds(page) && (page_p->page == page) && (page_p->page_state == req_state)) {
+        /* newer than the card */
+        memcpy((void*)page_p->data, &wc_buf[(page - wc_base) * PS2_PAGE_SIZE], PS2_PAGE_SIZE);
+        page_p->page_state = done_state;
+        hit = true;
+    } else if (line && (page_p->page == page) && (page_p->page_state == req_state)) {
+        memcpy(page_p->data, line->data, PS2_PAGE_SIZE);
+        if (line->prefetched) {
+            line->prefetched = false;
+            ra_used++;
+        }
+        page_p->page_state = done_state;
+        hit = true;
+    }
+    critical_section_exit(&crit);
+    if (hit)
+        return;
+
+    ps2_cardman_read_sector(page, page_p->data);
+
+    /* core1 may have moved the slot on to another page meanwhile, or queued a write to it */
+    critical_section_enter_blocking(&crit);
+    if ((page_p->page == page) && (page_p->page_state == req_state)) {
+        if (gen == rcache_write_gen)
+            rcache_insert(page, page_p->data, false);
+        page_p->page_state = done_state;
+    }
+    critical_section_exit(&crit);
+}
+
+static void ps2_mc_data_interface_complete_prefetch(uint32_t page, uint32_t gen) {
+    static uint8_t prefetch_buf[PS2_PAGE_SIZE];
+
+    critical_section_enter_blocking(&crit);
+    bool cached = rcache_find(page) != NULL;
+    critical_section_exit(&crit);
+    if (cached || wc_holds(page))
+        return;
+
+    ps2_cardman_read_sector(page, prefetch_buf);
+
+    /* a write since the prefetch was queued may have hit this page */
+    critical_section_enter_blocking(&crit);
+    if (gen == rcache_write_gen)
+        rcache_insert(page, prefetch_buf, true);
+    critical_section_exit(&crit);
+}
+
 void ps2_mc_data_interface_task(void) {
 
     write_occured = false;
@@ -478,36 +834,33 @@ void ps2_mc_data_interface_task(void) {
         busy_cycle = false;
 
         while ((op_fill_status() > 0) && ((time_us_64() - time_start) < MAX_TIME_SLICE) ){
-            volatile ps2_mcdi_page_t* page_p = pop_op();
+            ps2_mcdi_op_t op = pop_op();
+            volatile ps2_mcdi_page_t* page_p = op.page;
             busy_cycle = true;
-            if (page_p)
+            if (op.type == OP_TYPE_PREFETCH) {
+                log(LOG_INFO, "%s Prefetching page %u\n", __func__, op.prefetch_page);
+                ps2_mc_data_interface_complete_prefetch(op.prefetch_page, op.prefetch_gen);
+            } else if (page_p)
                 switch(page_p->page_state) {
                     case PAGE_READ_REQ:
                         log(LOG_INFO, "%s Reading page %u\n", __func__, page_p->page);
-                        ps2_cardman_read_sector(page_p->page, page_p->data);
-                        ps2_mc_data_interface_set_page(page_p, page_p->page, PAGE_DATA_AVAILABLE);
+                        ps2_mc_data_interface_complete_read(page_p, PAGE_READ_REQ, PAGE_DATA_AVAILABLE);
                         break;
                     case PAGE_READ_AHEAD_REQ:
                         log(LOG_INFO, "%s Reading ahead page %u\n", __func__, page_p->page);
-                        ps2_cardman_read_sector(page_p->page, page_p->data);
-                        ps2_mc_data_interface_set_page(page_p, page_p->page, PAGE_READ_AHEAD_AVAILABLE);
+                        ps2_mc_data_interface_complete_read(page_p, PAGE_READ_AHEAD_REQ, PAGE_READ_AHEAD_AVAILABLE);
                         break;
                     case PAGE_WRITE_REQ:
                         log(LOG_INFO, "%s Writing page %u\n", __func__, page_p->page);
                         write_occured = true;
-                        ps2_cardman_write_sector(page_p->page, page_p->data);
-                        ps2_history_tracker_registerPageWrite(page_p->page);
+                        wc_write(page_p->page, page_p->data);
                         ps2_mc_data_interface_set_page(page_p, 0, PAGE_EMPTY);
                         flush_req = true;
                         break;
                     case PAGE_ERASE_REQ:
                         log(LOG_INFO, "%s Erasing page %u\n", __func__, page_p->page);
                         write_occured = true;
-                        uint8_t erase_buff[PS2_PAGE_SIZE] = { 0x0 };
-                        memset((void*)erase_buff, 0xFF, PS2_PAGE_SIZE);
-                        for (int j = 0; j < ERASE_SECTORS; j++) {
-                            ps2_cardman_write_sector(page_p->page + j, erase_buff);
-                        }
+                        wc_erase(page_p->page);
                         critical_section_enter_blocking(&crit);
                         page_p->page = 0;
                         page_p->page_state = PAGE_EMPTY;
@@ -521,6 +874,7 @@ void ps2_mc_data_interface_task(void) {
         if (op_fill_status() > 0) {
             log(LOG_INFO, "%u left\n", op_fill_status());
         } else if (flush_req) {
+            wc_flush();
             ps2_cardman_flush();
             flush_req = false;
         }
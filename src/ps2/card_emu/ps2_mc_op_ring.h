@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Single producer / single consumer index ring, the entries live in an array owned by the user.
+ * Head and tail count modulo twice the size, so a full ring is told apart from an empty one, and are
+ * each written by their owner only, so no lock is needed: an entry is published by the release store
+ * of head, and only released for reuse by the release store of tail. Kept free of SDK dependencies so
+ * it can be exercised on the host.
+ */
+typedef struct {
+    uint32_t head;  // written by the producer only
+    uint32_t tail;  // written by the consumer only
+} ps2_mc_op_ring_t;
+
+static inline void ps2_mc_op_ring_reset(ps2_mc_op_ring_t* ring) {
+    __atomic_store_n(&ring->head, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, 0, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t ps2_mc_op_ring_next(uint32_t idx, uint32_t size) {
+    return (idx + 1 == 2 * size) ? 0 : idx + 1;
+}
+
+static inline uint32_t ps2_mc_op_ring_fill(ps2_mc_op_ring_t* ring, uint32_t size) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    return (head + 2 * size - tail) % (2 * size);
+}
+
+/* producer: index of the entry to fill, or -1 while the ring is full */
+static inline int ps2_mc_op_ring_push_slot(ps2_mc_op_ring_t* ring, uint32_t size) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    /* acquire: the consumer is done with the entry before it is overwritten */
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if ((head + 2 * size - tail) % (2 * size) == size)
+        return -1;
+    return head % size;
+}
+
+/* producer: publish the entry returned by ps2_mc_op_ring_push_slot */
+static inline void ps2_mc_op_ring_push_commit(ps2_mc_op_ring_t* ring, uint32_t size) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&ring->head, ps2_mc_op_ring_next(head, size), __ATOMIC_RELEASE);
+}
+
+/* consumer: index of the oldest entry, or -1 while the ring is empty */
+static inline int ps2_mc_op_ring_pop_slot(ps2_mc_op_ring_t* ring, uint32_t size) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    /* acquire: the entry is fully written once head has moved past it */
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+        return -1;
+    return tail % size;
+}
+
+/* consumer: hand the entry returned by ps2_mc_op_ring_pop_slot back to the producer */
+static inline void ps2_mc_op_ring_pop_commit(ps2_mc_op_ring_t* ring, uint32_t size) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&ring->tail, ps2_mc_op_ring_next(tail, size), __ATOMIC_RELEASE);
+}
@@ -17,6 +17,7 @@
 
 #include "ps2/card_emu/ps2_memory_card.h"
 #include "ps2_mmceman_commands.h"
+#include "ps2_mmceman_fs.h"
 #include "ps2/ps2_cardman.h"
 
 #include "game_db/game_db.h"
@@ -125,6 +126,7 @@ void ps2_mmceman_task(void) {
         // close old card
         ps2_memory_card_exit();
         log(LOG_TRACE, "%s After Exit\n", __func__);
+        ps2_mmceman_fs_flush();
         ps2_mc_data_interface_flush();
         ps2_cardman_close();
         log(LOG_TRACE, "%s After Close\n", __func__);
@@ -451,10 +451,8 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             //Update transferred count
             op_data->bytes_transferred += bytes_left_in_packet;
 
-            //Enter crit and mark chunk as consumed
-            critical_section_enter_blocking(&mmceman_fs_crit);
+            //Mark chunk as consumed
             op_data->chunk_state[op_data->tail_idx] = CHUNK_STATE_NOT_READY;
-            critical_section_exit(&mmceman_fs_crit);
 
             log(LOG_TRACE, "%u c, bip: %u\n", op_data->tail_idx, (bytes_left_in_packet + 1));
 
@@ -502,16 +500,16 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
     uint8_t *len8 = NULL;
     uint8_t *bytes8 = NULL;
 
-    //4096 bytes
     uint32_t bytes_left_in_packet;
     uint32_t next_chunk;
 
-    /* NOTE: Writes behave a bit differently from reads. Writes wait for a 4KB buffer to be filled (or until len has been read)
+    /* NOTE: Writes behave a bit differently from reads. Writes wait for a 4KB buffer (WRITE_CHUNK) to be filled (or until len has been read)
     *  before writing to the sdcard. While writing to the sdcard the PS2 will wait mid transfer for up to 2 seconds.
     *  Once the write is complete, the process will repeat if there is more data or move onto the final transfer stage */
     switch(mmceman_transfer_stage) {
         //Packet 1: File descriptor, length, and return value
         case 0:
+            MP_CMD_START();
             mmceman_op_in_progress = true;
 
             ps2_mmceman_fs_wait_ready();            //Wait for file handling to be ready
@@ -594,7 +592,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             }
 
             //If bytes received == 4KB or bytes received == length
-            if ((((op_data->bytes_transferred) % 4096) == 0) || (op_data->length == op_data->bytes_transferred)) {
+            if ((((op_data->bytes_transferred) % WRITE_CHUNK) == 0) || (op_data->length == op_data->bytes_transferred)) {
 
                 //Move back to polling stage
                 mmceman_transfer_stage = 1;
@@ -633,6 +631,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(term);
 
             mmceman_op_in_progress = false;
+            MP_CMD_END_BYTES(op_data->bytes_written);
         break;
     }
 }
@@ -1426,10 +1425,8 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
 
             //Using ring buffer
             } else {
-                //Enter crit and mark chunk as consumed
-                critical_section_enter_blocking(&mmceman_fs_crit);
+                //Mark chunk as consumed
                 op_data->chunk_state[op_data->tail_idx] = CHUNK_STATE_NOT_READY;
-                critical_section_exit(&mmceman_fs_crit);
 
                 log(LOG_TRACE, "%u c, bip: %u\n", op_data->tail_idx, (bytes_left_in_packet + 1));
 
@@ -1460,7 +1457,7 @@ inline __attribute__((always_inline)) void __time_critical_func(ps2_mmceman_cmd_
             mc_respond(count8[0x1]); receiveOrNextCmd(&cmd);
             mc_respond(count8[0x0]); receiveOrNextCmd(&cmd);
 
-            ps2_mmceman_fs_signal_operation(MMCEMAN_FS_READ_AHEAD);
+            ps2_mmceman_fs_post_operation(MMCEMAN_FS_READ_AHEAD, op_data->fd);
 
             ps2_mmceman_set_cb(NULL);
 
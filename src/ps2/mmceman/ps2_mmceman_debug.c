@@ -17,3 +17,14 @@ void mmce_profiling_stat()
     //printf("Signal op -> start of op: %liuS\n", cmd_mmce_fs_diff);
     printf("\n");
 }
+
+//Throughput of a data transfer command, e.g. fs_write
+void mmce_profiling_stat_bytes(uint32_t bytes)
+{
+    long cmd_elasped = (tv_end_cmd.tv_sec - tv_start_cmd.tv_sec) * 1000000 + tv_end_cmd.tv_usec - tv_start_cmd.tv_usec;
+
+    printf("[STAT] Command completed in: %liuS\n", cmd_elasped);
+    if (cmd_elasped > 0)
+        printf("[STAT] %lu bytes, %lu KB/s\n", (unsigned long)bytes, (unsigned long)(((uint64_t)bytes * 1000000 / cmd_elasped) / 1024));
+    printf("\n");
+}
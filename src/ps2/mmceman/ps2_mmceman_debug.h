@@ -12,9 +12,11 @@
 #define MP_SIGNAL_OP(x...)
 #define MP_OP_START(x...)
 #define MP_OP_END(x...)
+#define MP_CMD_END_BYTES(x...)
 #else
 extern struct timeval tv_start_cmd, tv_end_cmd, tv_signal_mmce_fs, tv_start_mmce_fs, tv_end_mmce_fs;
 extern void mmce_profiling_stat();
+extern void mmce_profiling_stat_bytes(uint32_t bytes);
 #define MP_CMD_START() gettimeofday(&tv_start_cmd, 0)
 #define MP_SIGNAL_OP() gettimeofday(&tv_signal_mmce_fs, 0)
 #define MP_OP_START() gettimeofday(&tv_start_mmce_fs, 0)
@@ -23,6 +25,10 @@ extern void mmce_profiling_stat();
                         gettimeofday(&tv_end_cmd, 0); \
                         mmce_profiling_stat(); \
                     } while (0)
+#define MP_CMD_END_BYTES(bytes) do { \
+                        gettimeofday(&tv_end_cmd, 0); \
+                        mmce_profiling_stat_bytes(bytes); \
+                    } while (0)
 #endif
 
 
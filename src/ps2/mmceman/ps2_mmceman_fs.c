@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <sys/_default_fcntl.h>
 #include <sys/stat.h>
@@ -10,13 +11,16 @@
 
 #include "pico/multicore.h"
 #include "pico/time.h"
+#include "hardware/sync.h"
 #include "sd.h"
 
 #include "debug.h"
+#include "bigmem.h"
 #include "ps2_cardman.h"
 #include "ps2_mmceman.h"
 #include "ps2_mmceman_debug.h"
 #include "card_emu/ps2_mc_internal.h"
+#include "card_emu/ps2_mc_data_interface.h"
 
 #if LOG_LEVEL_MMCEMAN_FS == 0
 #define log(x...)
@@ -27,7 +31,390 @@
 //Global data struct
 static volatile ps2_mmceman_fs_op_data_t op_data;
 static volatile uint32_t mmceman_fs_operation;
-critical_section_t mmceman_fs_crit;
+
+/* Per fd read ahead window (core0 only). Holds file data [pos, pos + len), the first off bytes of it
+ * are already consumed. While a stream is attached the sd file position sits at pos + len, the
+ * position seen by the PS2 is pos + off */
+#define STREAM_SIZE 4096
+#define STREAM_COUNT 2
+#define STREAM_STEP 1024    //Bytes topped up per idle pass
+
+typedef struct ps2_mmceman_fs_stream_t {
+    int fd;
+    uint32_t last_use;
+    uint64_t pos;
+    uint32_t len;
+    uint32_t off;
+    uint8_t buffer[STREAM_SIZE];
+} ps2_mmceman_fs_stream_t;
+
+static ps2_mmceman_fs_stream_t streams[STREAM_COUNT];
+static uint32_t stream_use;
+
+/* Write back: fds written since their last sd_flush. The dir entry / FAT update is deferred
+ * until close, FLUSH_IDLE_US without writes or a card switch */
+#define FLUSH_IDLE_US (1000 * 1000)
+
+static uint32_t unflushed_fds;
+static uint64_t last_write_us;
+
+/* Write batching: consecutive WRITE_CHUNK sized writes to one fd are collected here and go to the
+ * sdcard as a single sd_write once the batch is full, any other op comes in or writes go idle.
+ * A batch that fails to write is reported by the next write or close of its fd */
+#define WRITE_BATCH_SIZE (8 * 1024)
+
+static uint8_t write_batch[WRITE_BATCH_SIZE];
+static int write_batch_fd = -1;
+static uint32_t write_batch_len;
+static uint32_t write_failed_fds;
+
+/* Posted requests: ops core1 does not wait on, each carrying its own context instead of op_data.
+ * Core0 runs them in order ahead of the next foreground op, so ordering per fd is kept */
+#define POST_QUEUE_DEPTH 4
+
+typedef struct ps2_mmceman_fs_req_t {
+    uint8_t op;
+    int fd;
+} ps2_mmceman_fs_req_t;
+
+static ps2_mmceman_fs_req_t post_queue[POST_QUEUE_DEPTH];
+static volatile uint32_t post_head;    //written by core1
+static volatile uint32_t post_tail;    //written by core0
+
+/* Directory snapshot: DOPEN reads the whole listing into bigmem as packed entries and DREAD is
+ * served from there. A listing too big to fit keeps the entry that did not fit open on the iterator
+ * and carries on from it once the snapshot is used up. A listing that loses its snapshot early
+ * (invalidated or replaced by another DOPEN) rewinds the dir and skips the entries already served */
+typedef struct __attribute__((packed)) ps2_mmceman_fs_dir_entry_t {
+    ps2_fileio_stat_t stat;
+    uint8_t name_len;
+    char name[];        //null terminated
+} ps2_mmceman_fs_dir_entry_t;
+
+#define DIR_NAME_MAX 128
+
+#if WITH_PSRAM
+#define dir_cache bigmem.ps2.dir_cache
+static int dir_fd = -1;         //dir the snapshot belongs to
+static uint32_t dir_hash;       //of its path
+static uint32_t dir_len;        //bytes of entries
+static uint32_t dir_next;       //offset of the next entry to serve
+static bool dir_truncated;      //listing did not fit
+#endif
+
+static uint16_t dir_served[17]; //entries served per dir fd
+static bool dir_pending[17];    //iterator already holds the next entry
+static uint32_t fd_dir_hash[17];//parent dir of fds open for writing, 0 if none
+
+static ps2_mmceman_fs_stream_t *stream_find(int fd)
+{
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (streams[i].fd == fd && fd >= 0)
+            return &streams[i];
+    }
+    return NULL;
+}
+
+//Detach a stream, putting the file position back to where the PS2 expects it
+static void stream_drop(ps2_mmceman_fs_stream_t *st)
+{
+    if (st == NULL || st->fd < 0)
+        return;
+
+    if (st->off != st->len)
+        sd_seek64(st->fd, st->pos + st->off, SEEK_SET);
+
+    st->fd = -1;
+}
+
+static ps2_mmceman_fs_stream_t *stream_get(int fd)
+{
+    ps2_mmceman_fs_stream_t *st = stream_find(fd);
+
+    if (st == NULL) {
+        st = &streams[0];
+        for (int i = 1; i < STREAM_COUNT; i++) {
+            if (st->fd < 0)
+                break;
+            if (streams[i].fd < 0 || streams[i].last_use < st->last_use)
+                st = &streams[i];
+        }
+        stream_drop(st);
+
+        st->fd = fd;
+        st->pos = sd_tell64(fd);
+        st->len = 0;
+        st->off = 0;
+        log(LOG_INFO, "Stream attached to fd %i at %llu\n", fd, (long long unsigned int)st->pos);
+    }
+
+    st->last_use = ++stream_use;
+    return st;
+}
+
+//Read up to max more bytes into the window, returns the number of bytes added or -1
+static int stream_fill(ps2_mmceman_fs_stream_t *st, uint32_t max)
+{
+    uint64_t end, size;
+    uint32_t count;
+    int rv;
+
+    //Drop consumed data
+    if (st->off > 0) {
+        memmove(st->buffer, &st->buffer[st->off], st->len - st->off);
+        st->pos += st->off;
+        st->len -= st->off;
+        st->off = 0;
+    }
+
+    end = st->pos + st->len;
+    size = sd_filesize64(st->fd);
+    if (end >= size)
+        return 0;
+
+    count = STREAM_SIZE - st->len;
+    if (count > max)
+        count = max;
+    if (size - end < count)
+        count = size - end;
+
+    rv = sd_read(st->fd, &st->buffer[st->len], count);
+    if (rv > 0)
+        st->len += rv;
+
+    return rv;
+}
+
+static int stream_read(int fd, uint8_t *buf, uint32_t count)
+{
+    ps2_mmceman_fs_stream_t *st = stream_get(fd);
+    uint32_t done = 0;
+    uint32_t n;
+    int rv;
+
+    while (done < count) {
+        if (st->off == st->len) {
+            //Window drained, large reads go straight to the destination
+            if (count - done >= STREAM_STEP) {
+                n = count - done;
+                rv = sd_read(fd, &buf[done], n);
+
+                st->pos += st->len + (rv > 0 ? rv : 0);
+                st->len = 0;
+                st->off = 0;
+
+                if (rv > 0)
+                    done += rv;
+                if (rv != (int)n)
+                    break;
+                continue;
+            }
+
+            if (stream_fill(st, STREAM_SIZE) <= 0)
+                break;
+        }
+
+        n = st->len - st->off;
+        if (n > count - done)
+            n = count - done;
+
+        memcpy(&buf[done], &st->buffer[st->off], n);
+        st->off += n;
+        done += n;
+    }
+
+    return done;
+}
+
+//Seek inside the window if possible, otherwise detach the stream and let the caller seek the file
+static bool stream_seek(int fd, int64_t offset, int whence, uint64_t *position)
+{
+    ps2_mmceman_fs_stream_t *st = stream_find(fd);
+    uint64_t target;
+
+    if (st == NULL)
+        return false;
+
+    if (whence == SEEK_SET) {
+        target = offset;
+    } else if (whence == SEEK_CUR) {
+        target = st->pos + st->off + offset;
+    } else {
+        stream_drop(st);
+        return false;
+    }
+
+    if (target >= st->pos && target <= st->pos + st->len) {
+        st->off = target - st->pos;
+        *position = target;
+        return true;
+    }
+
+    stream_drop(st);
+    return false;
+}
+
+//Keep the most recently used window topped up between commands
+static void stream_refill(void)
+{
+    ps2_mmceman_fs_stream_t *st = NULL;
+
+    //Card page reads core1 waits on go first
+    if (ps2_mc_data_interface_get_sdmode() || !ps2_cardman_is_idle())
+        return;
+
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (streams[i].fd >= 0 && (st == NULL || streams[i].last_use > st->last_use))
+            st = &streams[i];
+    }
+
+    if (st != NULL && (STREAM_SIZE - (st->len - st->off)) >= STREAM_STEP)
+        stream_fill(st, STREAM_STEP);
+}
+
+//Case insensitive hash of a directory path, without trailing slashes
+static uint32_t dir_path_hash(const char *path, size_t len)
+{
+    uint32_t hash = 5381;
+
+    while (len > 0 && path[len - 1] == '/')
+        len--;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = path[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        hash = hash * 33 + (uint8_t)c;
+    }
+
+    return hash ? hash : 1;
+}
+
+static uint32_t parent_path_hash(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+
+    return dir_path_hash(path, slash ? (size_t)(slash - path) : 0);
+}
+
+static void dir_release(void)
+{
+#if WITH_PSRAM
+    if (dir_fd >= 0) {
+        log(LOG_INFO, "Dir snapshot of fd %i released after %u entries\n", dir_fd, dir_served[dir_fd]);
+        //Used up, the dir is positioned right after the entry that did not fit
+        if (dir_truncated && dir_next >= dir_len) {
+            dir_pending[dir_fd] = true;
+            dir_served[dir_fd] = 0;
+        }
+        dir_fd = -1;
+    }
+#endif
+}
+
+static void dir_close(int fd)
+{
+#if WITH_PSRAM
+    if (fd == dir_fd)
+        dir_release();
+#endif
+    if (fd >= 0 && fd < 17) {
+        dir_served[fd] = 0;
+        dir_pending[fd] = false;
+    }
+}
+
+//Something in the dir with this hash changed
+static void dir_invalidate(uint32_t hash)
+{
+#if WITH_PSRAM
+    if (dir_fd >= 0 && hash == dir_hash)
+        dir_release();
+#else
+    (void)hash;
+#endif
+}
+
+static void dir_snapshot(int fd, const char *path)
+{
+#if WITH_PSRAM
+    ps2_mmceman_fs_dir_entry_t *entry;
+    ps2_fileio_stat_t stat;
+    char name[DIR_NAME_MAX + 1];
+    size_t name_len;
+    int it = -1;
+
+    dir_release();
+
+    dir_len = 0;
+    dir_next = 0;
+    dir_truncated = false;
+
+    while ((it = sd_iterate_dir(fd, it)) != -1) {
+        name_len = sd_get_name(it, name, sizeof(name));
+
+        //Keep the entry that did not fit for the iterator to serve after the snapshot
+        if (dir_len + sizeof(*entry) + name_len + 1 > MMCE_DIR_CACHE_SIZE) {
+            op_data.it_fd[fd] = it;
+            dir_truncated = true;
+            break;
+        }
+
+        //Entries are packed, stat goes through an aligned copy
+        memset(&stat, 0, sizeof(stat));
+        sd_get_stat(it, &stat);
+
+        entry = (ps2_mmceman_fs_dir_entry_t*)&dir_cache[dir_len];
+        memcpy(&entry->stat, &stat, sizeof(stat));
+        entry->name_len = name_len;
+        memcpy(entry->name, name, name_len + 1);
+        dir_len += sizeof(*entry) + name_len + 1;
+    }
+
+    dir_fd = fd;
+    dir_hash = dir_path_hash(path, strlen(path));
+
+    log(LOG_INFO, "Dir snapshot of fd %i: %u bytes%s\n", fd, dir_len, dir_truncated ? ", truncated" : "");
+#else
+    (void)fd;
+    (void)path;
+#endif
+}
+
+//Serve the next entry of fd from its snapshot, returns false if the iterator has to take over
+static bool dir_read_cached(int fd)
+{
+#if WITH_PSRAM
+    ps2_mmceman_fs_dir_entry_t *entry;
+
+    if (fd != dir_fd)
+        return false;
+
+    if (dir_next >= dir_len) {
+        if (dir_truncated) {
+            dir_release();
+            return false;
+        }
+        op_data.rv = -1;
+        return true;
+    }
+
+    entry = (ps2_mmceman_fs_dir_entry_t*)&dir_cache[dir_next];
+    dir_next += sizeof(*entry) + entry->name_len + 1;
+    dir_served[fd]++;
+
+    memcpy((void*)&op_data.fileio_stat, &entry->stat, sizeof(entry->stat));
+    memcpy((void*)op_data.buffer[0], entry->name, entry->name_len + 1);
+
+    op_data.length = entry->name_len + 1;
+    op_data.buffer[0][op_data.length] = '\0'; //add null term
+    op_data.rv = 0;
+    return true;
+#else
+    (void)fd;
+    return false;
+#endif
+}
 
 void ps2_mmceman_fs_init(void)
 {
@@ -58,37 +445,177 @@ void ps2_mmceman_fs_init(void)
 
     memset((void*)op_data.chunk_state, 0, sizeof(op_data.chunk_state));
 
-    if (!mmceman_fs_crit.spin_lock)
-        critical_section_init(&mmceman_fs_crit);
+    for (int i = 0; i < STREAM_COUNT; i++)
+        streams[i].fd = -1;
+
+    unflushed_fds = 0;
+    write_batch_fd = -1;
+    write_batch_len = 0;
+    write_failed_fds = 0;
+
+    dir_release();
+    memset(dir_served, 0, sizeof(dir_served));
+    memset(dir_pending, 0, sizeof(dir_pending));
+    memset(fd_dir_hash, 0, sizeof(fd_dir_hash));
+
+    post_tail = post_head;
 
     mmceman_fs_operation = MMCEMAN_FS_NONE;
 }
 
 bool ps2_mmceman_fs_idle(void)
 {
-    return (mmceman_fs_operation == MMCEMAN_FS_NONE);
+    return (mmceman_fs_operation == MMCEMAN_FS_NONE) && (post_tail == post_head);
+}
+
+static void write_batch_flush(void)
+{
+    int rv;
+
+    if (write_batch_len == 0)
+        return;
+
+    log(LOG_INFO, "Writing batch: %u to sd\n", write_batch_len);
+    rv = sd_write(write_batch_fd, write_batch, write_batch_len);
+    if (rv != (int)write_batch_len) {
+        log(LOG_ERROR, "Failed to write batch of %u bytes, wrote %i\n", write_batch_len, rv);
+        if (write_batch_fd >= 0 && write_batch_fd < 32)
+            write_failed_fds |= (1u << write_batch_fd);
+    }
+
+    //Flush deferred
+    if (write_batch_fd >= 0 && write_batch_fd < 32)
+        unflushed_fds |= (1u << write_batch_fd);
+
+    write_batch_fd = -1;
+    write_batch_len = 0;
+}
+
+//Returns true once if a batched write to fd failed since the last check
+static bool write_failed(int fd)
+{
+    if (fd < 0 || fd >= 32 || !(write_failed_fds & (1u << fd)))
+        return false;
+
+    write_failed_fds &= ~(1u << fd);
+    return true;
+}
+
+void ps2_mmceman_fs_flush(void)
+{
+    write_batch_flush();
+
+    for (int fd = 0; unflushed_fds != 0; fd++) {
+        if (unflushed_fds & (1u << fd)) {
+            sd_flush(fd);
+            unflushed_fds &= ~(1u << fd);
+        }
+    }
+}
+
+/* Try to read a single chunk ahead into a separate buffer, uses no op_data fields but read_ahead
+ * so it can run as a posted request */
+static void read_ahead(int fd)
+{
+    ps2_mmceman_fs_stream_t *st = stream_get(fd);
+    uint64_t filesize = sd_filesize64(fd);
+    int rv;
+
+    log(LOG_INFO, "Entering read ahead\n");
+
+    //Core1 may look at the buffer any time, retire the old contents first
+    op_data.read_ahead.valid = 0;
+
+    //Check if reading beyond file size
+    if (st->pos + st->off + CHUNK_SIZE <= filesize) {
+        op_data.read_ahead.pos = st->pos + st->off;
+        rv = stream_read(fd, (uint8_t*)op_data.read_ahead.buffer, CHUNK_SIZE);
+
+        if (rv == CHUNK_SIZE) {
+            log(LOG_INFO, "Read ahead: %i\n", rv);
+            op_data.read_ahead.fd = fd;
+            op_data.read_ahead.valid = 1;
+        } else {
+            log(LOG_ERROR, "Failed to read ahead %i bytes, got %i\n", CHUNK_SIZE, rv);
+        }
+    } else {
+        log(LOG_WARN, "Skipping request to read ahead beyond file length\n");
+    }
+}
+
+static void run_posted(void)
+{
+    while (post_tail != post_head) {
+        ps2_mmceman_fs_req_t *req = &post_queue[post_tail % POST_QUEUE_DEPTH];
+
+        switch (req->op) {
+            case MMCEMAN_FS_READ_AHEAD:
+                read_ahead(req->fd);
+            break;
+
+            default:
+                log(LOG_WARN, "Dropping posted op 0x%x\n", req->op);
+            break;
+        }
+
+        post_tail++;
+    }
 }
 
 void ps2_mmceman_fs_run(void)
 {
     uint32_t bytes_in_chunk = 0;
     uint32_t write_size = 0;
+    uint64_t position = 0;
+
+    //Anything but more writes sees the batch on the card first
+    if (write_batch_len != 0 && (post_tail != post_head
+        || (mmceman_fs_operation != MMCEMAN_FS_NONE
+            && mmceman_fs_operation != MMCEMAN_FS_WRITE
+            && mmceman_fs_operation != MMCEMAN_FS_VALIDATE_FD)))
+        write_batch_flush();
+
+    //Posted before whatever foreground op is pending now
+    run_posted();
 
     MP_OP_START();
 
     switch (mmceman_fs_operation) {
-        case MMCEMAN_FS_OPEN:
-            op_data.fd = sd_open((const char*)op_data.buffer[0], op_data.flags);
+        case MMCEMAN_FS_OPEN: {
+            const char *path = (const char*)op_data.buffer[0];
+            size_t path_len = strlen(path);
+
+            //Writes through MMCE do not go through cardman and would leave the sparse map of a card image stale
+            if ((op_data.flags & (O_WRONLY | O_RDWR)) && path_len > 4 && strcasecmp(&path[path_len - 4], ".mcd") == 0)
+                ps2_cardman_forget_sparse_map(path);
+
+            op_data.fd = sd_open(path, op_data.flags);
 
             if (op_data.fd < 0) {
                 log(LOG_ERROR, "Open failed, fd: %i\n", op_data.fd);
+            } else if (op_data.fd < 17) {
+                //Creating or writing a file changes the listing of its dir
+                fd_dir_hash[op_data.fd] = 0;
+                if (op_data.flags & (O_WRONLY | O_RDWR | O_CREAT)) {
+                    fd_dir_hash[op_data.fd] = parent_path_hash(path);
+                    dir_invalidate(fd_dir_hash[op_data.fd]);
+                }
             }
 
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
+        }
 
         case MMCEMAN_FS_CLOSE:
-            op_data.rv = sd_close(op_data.fd);
+            stream_drop(stream_find(op_data.fd));
+            op_data.rv = sd_close(op_data.fd);  //close syncs pending data
+            if (write_failed(op_data.fd))
+                op_data.rv = -1;
+
+            if (op_data.fd >= 0 && op_data.fd < 32)
+                unflushed_fds &= ~(1u << op_data.fd);
+            if (op_data.fd >= 0 && op_data.fd < 17)
+                fd_dir_hash[op_data.fd] = 0;
 
             //Discard data read ahead from file
             if (op_data.fd == op_data.read_ahead.fd) {
@@ -100,7 +627,11 @@ void ps2_mmceman_fs_run(void)
         break;
 
         //Read async continuous until bytes_read == length
-        case MMCEMAN_FS_READ:
+        case MMCEMAN_FS_READ: {
+            ps2_mmceman_fs_stream_t *st = stream_get(op_data.fd);
+            uint32_t free_chunks, ready_chunks;
+            uint64_t pos;
+
             log(LOG_INFO, "Entering read loop, bytes read: %u len: %u\n", op_data.bytes_read, op_data.length);
             mmceman_fs_abort_read = false;
 
@@ -114,87 +645,99 @@ void ps2_mmceman_fs_run(void)
                     break;
                 }
 
-                //Wait for chunk at head to be consumed
-                if (op_data.chunk_state[op_data.head_idx] != CHUNK_STATE_READY) {
+                //Count consumed chunks from head up to the end of the ring
+                bytes_in_chunk = (op_data.length - op_data.bytes_read);
+                free_chunks = 0;
+                while ((op_data.head_idx + free_chunks) <= CHUNK_COUNT
+                       && (free_chunks * CHUNK_SIZE) < bytes_in_chunk
+                       && (free_chunks * CHUNK_SIZE) < READ_ALIGN
+                       && op_data.chunk_state[op_data.head_idx + free_chunks] != CHUNK_STATE_READY)
+                    free_chunks++;
 
-                    //Get number of bytes to try reading
-                    bytes_in_chunk = (op_data.length - op_data.bytes_read);
+                //Wait for chunk at head to be consumed
+                if (free_chunks == 0)
+                    continue;
 
-                    //Cap at CHUNK_SIZE
-                    if (bytes_in_chunk > CHUNK_SIZE)
-                        bytes_in_chunk = CHUNK_SIZE;
+                //Get number of bytes to try reading
+                if (bytes_in_chunk > free_chunks * CHUNK_SIZE) {
+                    bytes_in_chunk = free_chunks * CHUNK_SIZE;
 
-                    //Read
-                    op_data.rv = sd_read(op_data.fd, (void*)op_data.buffer[op_data.head_idx], bytes_in_chunk);
+                    //End on an aligned file offset so the next read starts on one
+                    pos = st->pos + st->off;
+                    if ((pos % CHUNK_SIZE) == 0 && bytes_in_chunk > ((pos + bytes_in_chunk) % READ_ALIGN))
+                        bytes_in_chunk -= (pos + bytes_in_chunk) % READ_ALIGN;
+                }
 
-                    //Failed to get requested amount
-                    if (op_data.rv != (int)bytes_in_chunk) {
-                        op_data.bytes_read += op_data.rv;
-                        log(LOG_ERROR, "Failed to read %u bytes, got %i bytes\n", bytes_in_chunk, op_data.rv);
-                        critical_section_enter_blocking(&mmceman_fs_crit);
-                        op_data.chunk_state[op_data.head_idx] = CHUNK_STATE_INVALID; //Notify core0
-                        critical_section_exit(&mmceman_fs_crit);
-                        break;
-                    }
+                //Read straight into the ring, served from the fd's read ahead window where possible
+                op_data.rv = stream_read(op_data.fd, (uint8_t*)op_data.buffer[op_data.head_idx], bytes_in_chunk);
 
-                    //Update read count
-                    op_data.bytes_read += op_data.rv;
+                //Update read count
+                op_data.bytes_read += op_data.rv;
 
-                    //Enter crit and update chunk state
-                    critical_section_enter_blocking(&mmceman_fs_crit);
+                //Publish every complete chunk, and a partial last one
+                ready_chunks = (op_data.rv + CHUNK_SIZE - 1) / CHUNK_SIZE;
+                for (uint32_t i = 0; i < ready_chunks; i++) {
                     op_data.chunk_state[op_data.head_idx] = CHUNK_STATE_READY;
-                    critical_section_exit(&mmceman_fs_crit);
-
-                    log(LOG_TRACE, "%u r, bic %u\n", op_data.head_idx, bytes_in_chunk);
 
-                    //Increment head pointer
+                    //Increment head pointer, loop around
                     op_data.head_idx++;
-
-                    //Loop around
                     if (op_data.head_idx > CHUNK_COUNT)
                         op_data.head_idx = 0;
+                }
 
-                    sleep_us(1);
+                log(LOG_TRACE, "%u r, bic %u\n", op_data.head_idx, bytes_in_chunk);
+
+                //Failed to get requested amount
+                if (op_data.rv != (int)bytes_in_chunk) {
+                    log(LOG_ERROR, "Failed to read %u bytes, got %i bytes\n", bytes_in_chunk, op_data.rv);
+                    //Notify core1 on the chunk it waits for after the published ones
+                    while (op_data.chunk_state[op_data.head_idx] == CHUNK_STATE_READY && !mmceman_fs_abort_read)
+                        tight_loop_contents();
+                    op_data.chunk_state[op_data.head_idx] = CHUNK_STATE_INVALID;
+                    break;
                 }
             }
 
             log(LOG_INFO, "Exit read loop\n");
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
+        }
 
         /* Try to read a single chunk ahead into a separate buffer */
         case MMCEMAN_FS_READ_AHEAD:
-            op_data.filesize = sd_filesize64(op_data.fd);
-
-            log(LOG_INFO, "Entering read ahead\n");
-
-            //Check if reading beyond file size
-            if (sd_tell64(op_data.fd) + CHUNK_SIZE <= op_data.filesize) {
-                op_data.read_ahead.pos = sd_tell64(op_data.fd);
-                op_data.rv = sd_read(op_data.fd, (void*)op_data.read_ahead.buffer, CHUNK_SIZE);
-
-                if (op_data.rv == CHUNK_SIZE) {
-                    log(LOG_INFO, "Read ahead: %i\n", op_data.rv);
-                    op_data.read_ahead.fd = op_data.fd;
-                    op_data.read_ahead.valid = 1;
-                } else {
-                    log(LOG_ERROR, "Failed to read ahead %i bytes, got %i\n", CHUNK_SIZE, op_data.rv);
-                }
-            } else {
-                log(LOG_WARN, "Skipping request to read ahead beyond file length\n");
-            }
+            read_ahead(op_data.fd);
 
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
 
         case MMCEMAN_FS_WRITE:
-            write_size = op_data.bytes_transferred % 4096;
+            write_size = op_data.bytes_transferred % WRITE_CHUNK;
             if (write_size == 0)
-                write_size = 4096;
+                write_size = WRITE_CHUNK;
+
+            //Writes go to the position the PS2 sees
+            stream_drop(stream_find(op_data.fd));
 
-            log(LOG_INFO, "Writing: %u to sd\n", write_size);
-            op_data.rv = sd_write(op_data.fd, (void*)op_data.buffer[0], write_size);
-            sd_flush(op_data.fd); //flush data
+            if (op_data.fd >= 0 && op_data.fd < 17 && fd_dir_hash[op_data.fd])
+                dir_invalidate(fd_dir_hash[op_data.fd]);
+
+            if (write_failed(op_data.fd)) {
+                op_data.rv = -1;
+            } else {
+                //Only extend a batch of the same fd
+                if (write_batch_len != 0 && (write_batch_fd != op_data.fd || write_batch_len + write_size > WRITE_BATCH_SIZE))
+                    write_batch_flush();
+
+                log(LOG_INFO, "Batching: %u\n", write_size);
+                memcpy(&write_batch[write_batch_len], (void*)op_data.buffer[0], write_size);
+                write_batch_fd = op_data.fd;
+                write_batch_len += write_size;
+                op_data.rv = write_size;
+
+                if (write_batch_len == WRITE_BATCH_SIZE)
+                    write_batch_flush();
+            }
+            last_write_us = time_us_64();
 
             op_data.bytes_written += op_data.rv;
             log(LOG_INFO, "Wrote: %i, progress: %u of %u\n", op_data.rv, op_data.bytes_written, op_data.length);
@@ -217,8 +760,12 @@ void ps2_mmceman_fs_run(void)
                 op_data.read_ahead.valid = 0;
             }
 
-            sd_seek(op_data.fd, op_data.offset, op_data.whence);
-            op_data.position = sd_tell(op_data.fd);
+            if (stream_seek(op_data.fd, op_data.offset, op_data.whence, &position)) {
+                op_data.position = position;
+            } else {
+                sd_seek(op_data.fd, op_data.offset, op_data.whence);
+                op_data.position = sd_tell(op_data.fd);
+            }
 
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
@@ -238,34 +785,48 @@ void ps2_mmceman_fs_run(void)
                 op_data.read_ahead.valid = 0;
             }
 
-            sd_seek64(op_data.fd, op_data.offset64, op_data.whence64);
-            op_data.position64 = sd_tell64(op_data.fd);
+            if (stream_seek(op_data.fd, op_data.offset64, op_data.whence64, &position)) {
+                op_data.position64 = position;
+            } else {
+                sd_seek64(op_data.fd, op_data.offset64, op_data.whence64);
+                op_data.position64 = sd_tell64(op_data.fd);
+            }
 
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
 
         case MMCEMAN_FS_REMOVE:
             op_data.rv = sd_remove((const char*)op_data.buffer[0]);
+            dir_invalidate(parent_path_hash((const char*)op_data.buffer[0]));
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
 
         case MMCEMAN_FS_MKDIR:
             op_data.rv = sd_mkdir((const char*)op_data.buffer[0]);
+            dir_invalidate(parent_path_hash((const char*)op_data.buffer[0]));
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
 
         case MMCEMAN_FS_RMDIR:
             op_data.rv = sd_rmdir((const char*)op_data.buffer[0]);
+            dir_invalidate(parent_path_hash((const char*)op_data.buffer[0]));
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
 
         case MMCEMAN_FS_DOPEN:
             op_data.fd = sd_open((const char*)op_data.buffer[0], 0x0);
-            op_data.it_fd[op_data.fd] = -1; //clear itr stat
+            if (op_data.fd >= 0 && op_data.fd < 17) {
+                op_data.it_fd[op_data.fd] = -1; //clear itr stat
+                dir_served[op_data.fd] = 0;
+                dir_pending[op_data.fd] = false;
+                fd_dir_hash[op_data.fd] = 0;
+                dir_snapshot(op_data.fd, (const char*)op_data.buffer[0]);
+            }
             mmceman_fs_operation = MMCEMAN_FS_NONE;
         break;
 
         case MMCEMAN_FS_DCLOSE:
+            dir_close(op_data.fd);
             if (op_data.it_fd[op_data.fd] > 0) {
                 sd_close(op_data.it_fd[op_data.fd]); //if iterated on
                 op_data.it_fd[op_data.fd] = -1;
@@ -279,8 +840,25 @@ void ps2_mmceman_fs_run(void)
         break;
 
         case MMCEMAN_FS_DREAD:
-            //TODO: rework dir iteration
-            op_data.it_fd[op_data.fd] = sd_iterate_dir(op_data.fd, op_data.it_fd[op_data.fd]);
+            if (dir_read_cached(op_data.fd)) {
+                mmceman_fs_operation = MMCEMAN_FS_NONE;
+                break;
+            }
+
+            if (dir_pending[op_data.fd]) {
+                dir_pending[op_data.fd] = false;
+            } else {
+                uint16_t skip = dir_served[op_data.fd];
+
+                //Catch up with what the snapshot already served, from the start of the dir
+                dir_served[op_data.fd] = 0;
+                if (skip > 0)
+                    sd_rewind_dir(op_data.fd);
+
+                do {
+                    op_data.it_fd[op_data.fd] = sd_iterate_dir(op_data.fd, op_data.it_fd[op_data.fd]);
+                } while (op_data.it_fd[op_data.fd] != -1 && skip-- > 0);
+            }
 
             if (op_data.it_fd[op_data.fd] != -1) {
                 sd_get_stat(op_data.it_fd[op_data.fd], (ps2_fileio_stat_t*)&op_data.fileio_stat);
@@ -327,6 +905,13 @@ void ps2_mmceman_fs_run(void)
             log(LOG_INFO, "MMCEMAN FS Reset\n");
         break;
 
+        case MMCEMAN_FS_NONE:
+            if ((write_batch_len || unflushed_fds) && (time_us_64() - last_write_us) > FLUSH_IDLE_US)
+                ps2_mmceman_fs_flush();
+
+            stream_refill();
+        break;
+
         default:
         break;
     }
@@ -353,6 +938,20 @@ void ps2_mmceman_fs_signal_operation(int op)
     mmceman_fs_operation = op;
 }
 
+//Queue an op without waiting for it, returns false if the queue is full
+bool ps2_mmceman_fs_post_operation(int op, int fd)
+{
+    if (post_head - post_tail >= POST_QUEUE_DEPTH)
+        return false;
+
+    post_queue[post_head % POST_QUEUE_DEPTH].op = op;
+    post_queue[post_head % POST_QUEUE_DEPTH].fd = fd;
+    __dmb();
+    post_head++;
+
+    return true;
+}
+
 ps2_mmceman_fs_op_data_t *ps2_mmceman_fs_get_op_data(void)
 {
     return (ps2_mmceman_fs_op_data_t*)&op_data;
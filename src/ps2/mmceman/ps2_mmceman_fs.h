@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #include "pico/multicore.h"
 #include "pico/critical_section.h"
@@ -32,7 +33,13 @@
 #define MMCEMAN_FS_RESET 0x11
 
 #define CHUNK_SIZE 256
-#define CHUNK_COUNT 15
+#define CHUNK_COUNT 31
+
+//Bytes the PS2 sends between write "ready" polls, fixed by the protocol
+#define WRITE_CHUNK 4096
+
+//Largest single sd read filling the ring, reads end on multiples of this in the file where possible
+#define READ_ALIGN 4096
 
 #define CHUNK_STATE_NOT_READY 0x0
 #define CHUNK_STATE_READY 0x1
@@ -71,7 +78,7 @@ typedef struct ps2_mmceman_fs_op_data_t {
     uint8_t head_idx;           //read ring head idx
 
     uint8_t buffer[CHUNK_COUNT + 1][CHUNK_SIZE];
-    volatile uint8_t chunk_state[CHUNK_COUNT + 1]; //written to by both cores, writes encased in critical section
+    _Atomic uint8_t chunk_state[CHUNK_COUNT + 1]; //written to by both cores, core0 only moves a chunk to READY/INVALID, core1 only back to NOT_READY
 
     uint8_t transfer_failed;
     int use_read_ahead;
@@ -80,8 +87,6 @@ typedef struct ps2_mmceman_fs_op_data_t {
     ps2_fileio_stat_t fileio_stat;
 } ps2_mmceman_fs_op_data_t;
 
-extern critical_section_t mmceman_fs_crit; //used to lock writes to chunk_state (mmceman_commands <-> ps2_mmceman_fs)
-
 /* Flow (Core 1):
  * enter cmd handler function
  * ps2_mmceman_fs_wait_ready();               core1 waits for core0 to finish any ops (shouldn't be any)
@@ -94,16 +99,21 @@ extern critical_section_t mmceman_fs_crit; //used to lock writes to chunk_state
  * poll chunk state or other status var (read and dread do this)
  * access data
  * repeat
+ *
+ * Ops whose result core1 doesn't need (read ahead) are posted instead with
+ * ps2_mmceman_fs_post_operation(op, fd), they don't hold up the next command's wait_ready
 */
 
 //Core 0
 bool ps2_mmceman_fs_idle(void);
 void ps2_mmceman_fs_init(void);
 void ps2_mmceman_fs_run(void);
+void ps2_mmceman_fs_flush(void);
 
 //Core 1
 void ps2_mmceman_fs_wait_ready();
 void ps2_mmceman_fs_signal_operation(int op);
+bool ps2_mmceman_fs_post_operation(int op, int fd);
 int ps2_mmceman_fs_get_operation();
 
 
@@ -5,10 +5,13 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 #include "card_emu/ps2_mc_data_interface.h"
 #include "mmceman/ps2_mmceman.h"
+#include "config.h"
 #include "debug.h"
+#include "fnv.h"
 #include "game_db/game_db.h"
 #include "hardware/timer.h"
 #include "mmceman/ps2_mmceman_fs.h"
@@ -43,13 +46,115 @@ static int sector_count = -1;
 #define SECTOR_COUNT_8MB (PS2_CARD_SIZE_8M / BLOCK_SIZE)
 uint8_t available_sectors[SECTOR_COUNT_8MB / 8];  // bitmap
 #define PSRAM_AVAILABLE true
+
+/* card loading reads runs of up to 8 KB with one SD access, the run goes to PSRAM a sector per dirty lock hold */
+#define LOAD_RUN_SECTORS  (16)
+
+/* PSRAM side of a run, chained from the DMA completion irq while the SD side of the next run proceeds */
+typedef struct {
+    uint8_t *buf;
+    int first_sector;
+    int count;
+    bool load;              // to PSRAM, skipping sectors core1 wrote meanwhile and marking the rest available
+    volatile int next;
+    volatile bool stalled;  // the irq found the lock taken, the loader issues the next sector
+} psram_chain_t;
+
+static psram_chain_t chain;
+
+/* sidecar next to the card image, tracking which sectors were ever written; the rest is erased (0xFF) and never read from SD */
+#define SPARSE_MAP_SUFFIX ".map"
+#define SPARSE_MAP_MAGIC  "MCDMAP02"
+
+typedef struct {
+    char magic[8];
+    uint64_t fingerprint;  // card_fingerprint of the image the map belongs to
+    uint32_t card_size;
+} sparse_map_header_t;
+
+static uint8_t written_sectors[SECTOR_COUNT_8MB / 8];  // bitmap
+static char sparse_map_path[256 + sizeof(SPARSE_MAP_SUFFIX)];
+static bool sparse_map_active;   // map is maintained for the current card
+static bool sparse_map_trusted;  // map matches the card image
+static bool sparse_map_dirty;    // map has sectors the sidecar lacks, the sidecar has been removed
+static uint64_t sparse_map_fingerprint;  // the sidecar's, the image may have moved on by allocating clusters
+
+/* sectors core1 is waiting for, serviced by the loader before the background sweep; guarded by the dirty lock */
+#define PRIORITY_QUEUE_SIZE (8)
+
+static int priority_queue[PRIORITY_QUEUE_SIZE];
+static volatile int priority_head, priority_tail;
+
+/* filesystem metadata is loaded ahead of the linear sweep, one stage of the layout at a time */
+#define LAYOUT_PLAN_SIZE     (64)
+#define LAYOUT_MAX_FAT_CLUST (32)
+
+static enum { LAYOUT_SUPERBLOCK, LAYOUT_IFC, LAYOUT_FAT, LAYOUT_ROOTDIR, LAYOUT_SUBDIRS, LAYOUT_DONE } layout_stage;
+static int layout_plan[LAYOUT_PLAN_SIZE];
+static int layout_plan_count, layout_plan_pos;
+static uint32_t layout_pages_per_cluster, layout_alloc_offset, layout_rootdir_cluster;
+static uint32_t layout_ifc_list[32];
+static uint32_t layout_fat_clusters[LAYOUT_MAX_FAT_CLUST];
+static int layout_fat_cluster_count;
+static bool layout_corrupt;  // a cluster number read from the image lies beyond the card
+
+static int layout_next_sector(void);
+
+typedef bool (*card_read_fn)(const void *ctx, int sector, void *buf512);
+static bool card_fingerprint(card_read_fn read, const void *ctx, uint32_t size, uint64_t *fingerprint);
+static bool fingerprint_read_file(const void *fd, int sector, void *buf512);
+static bool fingerprint_read_psram(const void *unused, int sector, void *buf512);
+
+/*
+ * recently used card images stay in their own 8 MB PSRAM region, tagged so that switching back skips the reload;
+ * how many regions there are depends on the PSRAM found at boot
+ */
+#define RESIDENT_CARD_MAX (PSRAM_MAX_SIZE / PS2_CARD_SIZE_8M)
+
+typedef struct {
+    char path[256];
+    uint32_t card_size;
+    uint64_t fingerprint;  // card_fingerprint of the image the region holds
+    uint32_t last_use;
+    bool valid;
+} resident_card_t;
+
+static resident_card_t resident_cards[RESIDENT_CARD_MAX];
+static int resident_card_count = 1;
+static int resident_slot = -1;  // region of the open card, -1 in SD mode
+static uint32_t resident_tick;
+
+/* while everything is idle the predicted next card is streamed into a spare region, if there is one */
+static int preload_fd = -1;
+static int preload_slot;
+static int preload_sector, preload_sector_count;
+static bool preload_armed;
+static char preload_path[256];
+static uint64_t preload_fingerprint;
+static char preload_gameid_folder[MAX_FOLDER_NAME_LENGTH];  // game ID folder last opened, where a boot card leads to
+
+static void preload_cancel(void);
+
+static uint8_t load_buf[2][LOAD_RUN_SECTORS * BLOCK_SIZE];
 #else
 #define PSRAM_AVAILABLE false
 #endif
 static uint8_t flushbuf[BLOCK_SIZE];
+#if WITH_PSRAM
+/* SD mode cards are created through the load buffer, idle at that point */
+#define CREATE_RUN_SECTORS LOAD_RUN_SECTORS
+#define create_buf         load_buf[0]
+#else
+#define CREATE_RUN_SECTORS (8)
+static uint8_t create_buf[CREATE_RUN_SECTORS * BLOCK_SIZE];
+#endif
 int cardman_fd = -1;
+volatile uint32_t ps2_cardman_psram_base;
+/* first SD sector of a contiguous card image, sector I/O then skips the file layer; 0 if fragmented */
+static uint32_t raw_first_sector;
+static char opened_path[256];  // path of the open card
 
-int current_read_sector = 0, priority_sector = -1;
+int current_read_sector = 0;
 
 #define MAX_GAME_NAME_LENGTH (127)
 #define MAX_PREFIX_LENGTH    (4)
@@ -110,19 +215,41 @@ static bool try_set_game_id_card() {
     return true;
 }
 
-int ps2_cardman_read_sector(int sector, void *buf512) {
-    if (cardman_fd < 0)
-        return -1;
+static bool raw_in_card(int sector, int count) {
+    return (raw_first_sector != 0) && (sector >= 0) && ((uint32_t)(sector + count) <= card_size / BLOCK_SIZE);
+}
+
+static void raw_setup(void) {
+    uint32_t first_sector, count;
+
+    raw_first_sector = 0;
+    if ((sd_contiguous_range(cardman_fd, &first_sector, &count) == 0) && (count >= card_size / BLOCK_SIZE)
+        && (sd_raw_begin(cardman_fd) == 0))
+        raw_first_sector = first_sector;
+    log(LOG_INFO, "%s: card image %s\n", __func__, raw_first_sector ? "contiguous" : "fragmented");
+}
+
+/* a raw mapped image is read raw too, the writes to it bypass the SdFat cache */
+static int read_sectors(int sector, void *buf, int count) {
+    if (raw_in_card(sector, count))
+        return (sd_read_sectors(raw_first_sector + sector, buf, count) == 0) ? 0 : -1;
 
     if (sd_seek(cardman_fd, sector * BLOCK_SIZE, SEEK_SET) != 0)
         return -1;
 
-    if (sd_read(cardman_fd, buf512, BLOCK_SIZE) != BLOCK_SIZE)
+    if (sd_read(cardman_fd, buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
         return -1;
 
     return 0;
 }
 
+int ps2_cardman_read_sector(int sector, void *buf512) {
+    if (cardman_fd < 0)
+        return -1;
+
+    return read_sectors(sector, buf512, 1);
+}
+
 static bool try_set_next_named_card() {
     bool ret = false;
     if (cardman_state != PS2_CM_STATE_NAMED) {
@@ -156,10 +283,200 @@ static bool try_set_prev_named_card() {
     return ret;
 }
 
+#if WITH_PSRAM
+static bool sparse_map_is_written(int sector) {
+    return written_sectors[sector / 8] & (1 << (sector % 8));
+}
+
+/* record a sector as written; the bitmap stays in RAM and is written back by sparse_map_store */
+static void sparse_map_mark(int sector) {
+    if (!sparse_map_active || sparse_map_is_written(sector))
+        return;
+
+    written_sectors[sector / 8] |= (1 << (sector % 8));
+
+    /* the sidecar no longer covers every written sector, drop it before the sector reaches the image */
+    if (sparse_map_trusted && !sparse_map_dirty) {
+        if (sd_exists(sparse_map_path))
+            sd_remove(sparse_map_path);
+        sparse_map_dirty = true;
+    }
+}
+
+static void sparse_map_scan(int first_sector, int count, const uint8_t *buf) {
+    for (int i = 0; i < count; i++) {
+        const uint32_t *words = (const uint32_t *)&buf[i * BLOCK_SIZE];
+        for (int j = 0; j < BLOCK_SIZE / 4; j++) {
+            if (words[j] != 0xFFFFFFFF) {
+                sparse_map_mark(first_sector + i);
+                break;
+            }
+        }
+    }
+}
+
+/* fingerprint is the image's card_fingerprint read from SD, NULL if it has none */
+static void sparse_map_open(const char *card_path, const uint64_t *fingerprint) {
+    sparse_map_header_t header;
+    int fd;
+
+    snprintf(sparse_map_path, sizeof(sparse_map_path), "%s%s", card_path, SPARSE_MAP_SUFFIX);
+    memset(written_sectors, 0, sizeof(written_sectors));
+    sparse_map_active = !ps2_mc_data_interface_get_sdmode();
+    sparse_map_trusted = false;
+    sparse_map_dirty = false;
+
+    if (sparse_map_active && fingerprint && (fd = sd_open(sparse_map_path, O_RDONLY)) >= 0) {
+        sparse_map_trusted = (sd_read(fd, &header, sizeof(header)) == sizeof(header))
+            && (memcmp(header.magic, SPARSE_MAP_MAGIC, sizeof(header.magic)) == 0)
+            && (header.card_size == card_size)
+            && (header.fingerprint == *fingerprint)
+            && (sd_read(fd, written_sectors, card_size / BLOCK_SIZE / 8) == (int)(card_size / BLOCK_SIZE / 8));
+        sd_close(fd);
+    }
+
+    if (sparse_map_trusted)
+        sparse_map_fingerprint = *fingerprint;
+
+    /* a stale map must not survive until the next open */
+    if (!sparse_map_trusted) {
+        memset(written_sectors, 0, sizeof(written_sectors));
+        if (sd_exists(sparse_map_path))
+            sd_remove(sparse_map_path);
+    }
+    log(LOG_INFO, "%s: %s %s\n", __func__, sparse_map_path, sparse_map_trusted ? "trusted" : "rebuilding");
+}
+
+#endif
+
+void ps2_cardman_forget_sparse_map(const char *card_path) {
+    /* the open image is also written through the file layer from now on, raw writes would bypass its cache */
+    if ((raw_first_sector != 0) && (strcasecmp(card_path + (card_path[0] == '/'), opened_path) == 0)) {
+        log(LOG_INFO, "%s: %s is written through MMCE, leaving raw access\n", __func__, opened_path);
+        raw_first_sector = 0;
+    }
+#if WITH_PSRAM
+    char map_path[sizeof(sparse_map_path)];
+
+    snprintf(map_path, sizeof(map_path), "%s%s", card_path, SPARSE_MAP_SUFFIX);
+    if (sd_exists(map_path))
+        sd_remove(map_path);
+
+    /* MMCE paths are absolute, cardman's are relative to the SD root; FAT names ignore case */
+    if (strcasecmp(map_path + (map_path[0] == '/'), sparse_map_path) == 0) {
+        sparse_map_active = false;
+        sparse_map_trusted = false;
+    }
+
+    /* a resident copy of the image is just as stale, and so is a preload of it in progress */
+    for (int i = 0; i < resident_card_count; i++)
+        if (strcasecmp(card_path + (card_path[0] == '/'), resident_cards[i].path) == 0)
+            resident_cards[i].valid = false;
+    if ((preload_fd >= 0) && (strcasecmp(card_path + (card_path[0] == '/'), preload_path) == 0))
+        preload_cancel();
+#endif
+}
+
+#if WITH_PSRAM
+/* persist the map built while loading the whole image, or grown by writes since */
+static void sparse_map_store(void) {
+    sparse_map_header_t header = { .magic = SPARSE_MAP_MAGIC, .card_size = card_size };
+
+    if (!sparse_map_active)
+        return;
+
+    /* PSRAM holds the whole image at this point, the same as SD */
+    if (!card_fingerprint(fingerprint_read_psram, NULL, card_size, &header.fingerprint)) {
+        if (sd_exists(sparse_map_path))
+            sd_remove(sparse_map_path);
+        sparse_map_trusted = false;
+        return;
+    }
+
+    if (sparse_map_trusted && !sparse_map_dirty && (header.fingerprint == sparse_map_fingerprint))
+        return;
+
+    int fd = sd_open(sparse_map_path, O_RDWR | O_CREAT | O_TRUNC);
+    if (fd < 0)
+        return;
+    bool ok = (sd_write(fd, &header, sizeof(header)) == sizeof(header))
+        && (sd_write(fd, written_sectors, card_size / BLOCK_SIZE / 8) == (int)(card_size / BLOCK_SIZE / 8));
+    sd_close(fd);
+
+    if (ok) {
+        sparse_map_trusted = true;
+        sparse_map_dirty = false;
+        sparse_map_fingerprint = header.fingerprint;
+    } else {
+        sd_remove(sparse_map_path);
+    }
+}
+#endif
+
+#if WITH_PSRAM
+/* fingerprint is the image's card_fingerprint read from SD, NULL if it has none */
+static int resident_find(const char *path, uint32_t size, const uint64_t *fingerprint) {
+    if (!fingerprint)
+        return -1;
+
+    for (int i = 0; i < resident_card_count; i++)
+        if (resident_cards[i].valid
+            && (resident_cards[i].card_size == size)
+            && (resident_cards[i].fingerprint == *fingerprint)
+            && (strcasecmp(resident_cards[i].path, path) == 0))
+            return i;
+    return -1;
+}
+
+/* least recently used region other than the open card's, unless one is free */
+static int resident_pick(void) {
+    int slot = -1;
+
+    for (int i = 0; i < resident_card_count; i++) {
+        if (i == resident_slot)
+            continue;
+        if (!resident_cards[i].valid)
+            return i;
+        if ((slot < 0) || (resident_cards[i].last_use < resident_cards[slot].last_use))
+            slot = i;
+    }
+    return slot;
+}
+
+static void resident_select(int slot, bool keep) {
+    resident_slot = slot;
+    ps2_cardman_psram_base = (uint32_t)slot * PS2_CARD_SIZE_8M;
+    resident_cards[slot].last_use = ++resident_tick;
+    /* the region only becomes valid again once the image is completely in */
+    if (!keep)
+        resident_cards[slot].valid = false;
+}
+
+/* tag the region with the image it now holds, an image without a content key cannot be matched later */
+static void resident_store(void) {
+    resident_card_t *card;
+
+    if (resident_slot < 0)
+        return;
+
+    card = &resident_cards[resident_slot];
+    snprintf(card->path, sizeof(card->path), "%s", opened_path);
+    card->card_size = card_size;
+    card->valid = card_fingerprint(fingerprint_read_psram, NULL, card_size, &card->fingerprint);
+}
+#endif
+
 int ps2_cardman_write_sector(int sector, void *buf512) {
     if (cardman_fd < 0)
         return -1;
 
+#if WITH_PSRAM
+    sparse_map_mark(sector);
+#endif
+
+    if (raw_in_card(sector, 1))
+        return (sd_write_sectors(raw_first_sector + sector, buf512, 1) == 0) ? 0 : -1;
+
     if (sd_seek(cardman_fd, sector * BLOCK_SIZE, SEEK_SET) != 0)
         return -1;
 
@@ -169,6 +486,28 @@ int ps2_cardman_write_sector(int sector, void *buf512) {
     return 0;
 }
 
+/* writes count consecutive sectors with a single seek */
+int ps2_cardman_write_sectors(int sector, int count, void *buf) {
+    if (cardman_fd < 0)
+        return -1;
+
+#if WITH_PSRAM
+    for (int i = 0; i < count; ++i)
+        sparse_map_mark(sector + i);
+#endif
+
+    if (raw_in_card(sector, count))
+        return (sd_write_sectors(raw_first_sector + sector, buf, count) == 0) ? 0 : -1;
+
+    if (sd_seek(cardman_fd, sector * BLOCK_SIZE, SEEK_SET) != 0)
+        return -1;
+
+    if (sd_write(cardman_fd, buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
+        return -1;
+
+    return 0;
+}
+
 bool ps2_cardman_is_sector_available(int sector) {
 #if WITH_PSRAM
     return available_sectors[sector / 8] & (1 << (sector % 8));
@@ -183,8 +522,27 @@ void ps2_cardman_mark_sector_available(int sector) {
 #endif
 }
 
-void ps2_cardman_set_priority_sector(int sector) {
-    priority_sector = sector;
+void __time_critical_func(ps2_cardman_set_priority_sector)(int sector) {
+#if WITH_PSRAM
+    ps2_dirty_lock();
+    for (int i = priority_head; i != priority_tail; i = (i + 1) % PRIORITY_QUEUE_SIZE) {
+        if (priority_queue[i] == sector) {
+            ps2_dirty_unlock();
+            return;
+        }
+    }
+
+    int next = (priority_tail + 1) % PRIORITY_QUEUE_SIZE;
+    if (next == priority_head) {
+        /* queue full, the oldest miss has most likely been given up on */
+        priority_head = (priority_head + 1) % PRIORITY_QUEUE_SIZE;
+    }
+    priority_queue[priority_tail] = sector;
+    priority_tail = next;
+    ps2_dirty_unlock();
+#else
+    (void)sector;
+#endif
 }
 
 void ps2_cardman_flush(void) {
@@ -382,16 +740,47 @@ static void genblock(size_t pos, void *vbuf) {
     }
 }
 
-static int next_sector_to_load() {
-    if (priority_sector != -1) {
-        if (ps2_cardman_is_sector_available(priority_sector))
-            priority_sector = -1;
-        else
-            return priority_sector;
+static bool sector_needs_load(int sector) {
+#if WITH_PSRAM
+    /* sectors of the run in flight become available as their transfers complete */
+    if ((chain.next < chain.count) && (sector >= chain.first_sector) && (sector < chain.first_sector + chain.count))
+        return false;
+#endif
+    return !ps2_cardman_is_sector_available(sector);
+}
+
+#if WITH_PSRAM
+static int next_priority_sector(void) {
+    int sector = -1;
+
+    ps2_dirty_lock();
+    while (priority_head != priority_tail) {
+        int queued = priority_queue[priority_head];
+        priority_head = (priority_head + 1) % PRIORITY_QUEUE_SIZE;
+        if (sector_needs_load(queued)) {
+            sector = queued;
+            break;
+        }
     }
+    ps2_dirty_unlock();
+
+    return sector;
+}
+#endif
+
+static int next_sector_to_load() {
+#if WITH_PSRAM
+    int priority_sector = next_priority_sector();
+    if (priority_sector != -1)
+        return priority_sector;
+
+    int layout_sector = layout_next_sector();
+    if (layout_sector != -1)
+        return layout_sector;
+#endif
 
     while (current_read_sector < sector_count) {
-        if (!ps2_cardman_is_sector_available(current_read_sector))
+        if (sector_needs_load(current_read_sector))
             return current_read_sector++;
         else
             current_read_sector++;
@@ -400,6 +789,385 @@ static int next_sector_to_load() {
     return -1;
 }
 
+#if WITH_PSRAM
+static bool sector_is_erased(int sector) {
+    return sparse_map_trusted && !sparse_map_is_written(sector);
+}
+
+/* extend a load run from its first sector over following sectors that are not in PSRAM yet */
+static int next_run_to_load(int *first_sector) {
+    int sector_idx = next_sector_to_load();
+    int count = 1;
+
+    if (sector_idx == -1)
+        return 0;
+
+    /* a run is either read from SD or entirely erased */
+    while ((count < LOAD_RUN_SECTORS)
+           && (sector_idx + count < sector_count)
+           && sector_needs_load(sector_idx + count)
+           && (sector_is_erased(sector_idx + count) == sector_is_erased(sector_idx)))
+        count++;
+
+    /* linear sweep continues behind this run */
+    if (current_read_sector > sector_idx && current_read_sector < sector_idx + count)
+        current_read_sector = sector_idx + count;
+
+    *first_sector = sector_idx;
+    return count;
+}
+
+static void chain_dma_done(void);
+
+/* called with the dirty lock held, which stays taken until the sector transfer completes */
+static void __time_critical_func(chain_issue)(void) {
+    /* core1 may have written a sector while the run was read from SD */
+    while (chain.load && (chain.next < chain.count) && ps2_cardman_is_sector_available(chain.first_sector + chain.next))
+        chain.next++;
+
+    if (chain.next == chain.count) {
+        ps2_dirty_unlock();
+        return;
+    }
+
+    uint32_t addr = ps2_cardman_psram_base + (chain.first_sector + chain.next) * BLOCK_SIZE;
+    uint8_t *buf = &chain.buf[chain.next * BLOCK_SIZE];
+    if (chain.load)
+        psram_write_dma(addr, buf, BLOCK_SIZE, chain_dma_done);
+    else
+        psram_read_dma(addr, buf, BLOCK_SIZE, chain_dma_done);
+}
+
+/* runs on core0; core1 gets the lock between any two sectors, as it did with one sector per lock hold */
+static void __time_critical_func(chain_dma_done)(void) {
+    if (chain.load)
+        ps2_cardman_mark_sector_available(chain.first_sector + chain.next);
+    chain.next++;
+    ps2_dirty_unlock();
+
+    if (chain.next == chain.count)
+        return;
+    if (ps2_dirty_try_lock())
+        chain_issue();
+    else
+        chain.stalled = true;
+}
+
+/* move a run between its buffer and PSRAM in the background, one sector per dirty lock hold */
+static void chain_start(bool load, uint8_t *buf, int first_sector, int count) {
+    chain.buf = buf;
+    chain.first_sector = first_sector;
+    chain.load = load;
+    chain.stalled = false;
+    chain.count = count;
+    chain.next = 0;
+
+    ps2_dirty_lock();
+    chain_issue();
+}
+
+static void chain_wait(void) {
+    while (chain.next < chain.count) {
+        /* no transfer is in flight while stalled */
+        if (chain.stalled) {
+            chain.stalled = false;
+            ps2_dirty_lock();
+            chain_issue();
+        }
+        tight_loop_contents();
+    }
+}
+#endif
+
+#if WITH_PSRAM
+static void layout_read_psram(uint32_t addr, void *buf, size_t len) {
+    ps2_dirty_lock();
+    psram_read_dma(ps2_cardman_psram_base + addr, buf, len, NULL);
+    psram_wait_for_dma();
+    ps2_dirty_unlock();
+}
+
+static bool fingerprint_read_file(const void *fd, int sector, void *buf512) {
+    return (sd_seek(*(const int *)fd, sector * BLOCK_SIZE, SEEK_SET) == 0)
+        && (sd_read(*(const int *)fd, buf512, BLOCK_SIZE) == BLOCK_SIZE);
+}
+
+/* the open card's region */
+static bool fingerprint_read_psram(const void *unused, int sector, void *buf512) {
+    (void)unused;
+    if (!ps2_cardman_is_sector_available(sector))
+        return false;
+    layout_read_psram(sector * BLOCK_SIZE, buf512, BLOCK_SIZE);
+    return true;
+}
+
+/*
+ * Content key of a formatted image: a hash of its superblock and of the IFC and FAT clusters these lead to,
+ * so any allocation change shows. The image's mtime cannot serve, writes through the card never move it as
+ * no SdFat date callback is set up, and a copy from a PC carries the same default time back.
+ */
+static bool card_fingerprint(card_read_fn read, const void *ctx, uint32_t size, uint64_t *fingerprint) {
+    uint32_t ifc_list[32], fat_clusters[LAYOUT_MAX_FAT_CLUST];
+    int fat_cluster_count = 0;
+    uint16_t page_len, pages_per_cluster;
+    uint64_t hash = FNV1A_64_INIT;
+
+    if (!read(ctx, CARD_OFFS_SUPERBLOCK / BLOCK_SIZE, flushbuf))
+        return false;
+    memcpy(&page_len, &flushbuf[0x28], sizeof(page_len));
+    memcpy(&pages_per_cluster, &flushbuf[0x2A], sizeof(pages_per_cluster));
+    memcpy(ifc_list, &flushbuf[0x50], sizeof(ifc_list));
+    if (memcmp(flushbuf, block0, 28) != 0 || page_len != BLOCK_SIZE || pages_per_cluster == 0 || pages_per_cluster > LOAD_RUN_SECTORS)
+        return false;
+    hash = fnv_64a_buf(flushbuf, BLOCK_SIZE, hash);
+
+    uint32_t cluster_count = size / BLOCK_SIZE / pages_per_cluster;
+    for (size_t i = 0; i < count_of(ifc_list) && ifc_list[i] != 0; i++) {
+        if (ifc_list[i] >= cluster_count)
+            return false;
+        for (uint32_t page = 0; page < pages_per_cluster; page++) {
+            if (!read(ctx, ifc_list[i] * pages_per_cluster + page, flushbuf))
+                return false;
+            hash = fnv_64a_buf(flushbuf, BLOCK_SIZE, hash);
+
+            for (size_t j = 0; j < BLOCK_SIZE / 4; j++) {
+                uint32_t entry;
+                memcpy(&entry, &flushbuf[j * 4], sizeof(entry));
+                if (entry == 0 || entry == 0xFFFFFFFF)
+                    break;
+                /* a FAT beyond what the layout stages load is not keyed */
+                if (entry >= cluster_count || fat_cluster_count == LAYOUT_MAX_FAT_CLUST)
+                    return false;
+                fat_clusters[fat_cluster_count++] = entry;
+            }
+        }
+    }
+
+    for (int i = 0; i < fat_cluster_count; i++) {
+        for (uint32_t page = 0; page < pages_per_cluster; page++) {
+            if (!read(ctx, fat_clusters[i] * pages_per_cluster + page, flushbuf))
+                return false;
+            hash = fnv_64a_buf(flushbuf, BLOCK_SIZE, hash);
+        }
+    }
+
+    *fingerprint = hash;
+    return true;
+}
+
+static void layout_reset(void) {
+    layout_stage = LAYOUT_SUPERBLOCK;
+    layout_plan[0] = CARD_OFFS_SUPERBLOCK / BLOCK_SIZE;
+    layout_plan_count = 1;
+    layout_plan_pos = 0;
+}
+
+static bool layout_cluster_valid(uint32_t cluster) {
+    return cluster < (uint32_t)sector_count / layout_pages_per_cluster;
+}
+
+static bool layout_plan_cluster(uint32_t cluster) {
+    /* checked before multiplying, so a corrupt cluster number cannot wrap into a valid looking sector */
+    if (!layout_cluster_valid(cluster)) {
+        layout_corrupt = true;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < layout_pages_per_cluster; i++) {
+        uint32_t sector = cluster * layout_pages_per_cluster + i;
+        if (layout_plan_count == LAYOUT_PLAN_SIZE)
+            return false;
+        layout_plan[layout_plan_count++] = sector;
+    }
+    return true;
+}
+
+static uint32_t layout_read_fat_entry(uint32_t cluster) {
+    uint32_t entries_per_cluster = layout_pages_per_cluster * BLOCK_SIZE / 4;
+    uint32_t fat_idx = cluster / entries_per_cluster;
+    uint32_t entry = 0xFFFFFFFF;
+
+    if ((fat_idx < (uint32_t)layout_fat_cluster_count) && layout_cluster_valid(layout_fat_clusters[fat_idx]))
+        layout_read_psram(layout_fat_clusters[fat_idx] * layout_pages_per_cluster * BLOCK_SIZE + (cluster % entries_per_cluster) * 4,
+                          &entry, sizeof(entry));
+
+    return entry;
+}
+
+/* parse the stage that was just loaded and plan the sectors of the next one */
+static void layout_advance(void) {
+    int prev_plan[LAYOUT_PLAN_SIZE];
+    int prev_plan_count = layout_plan_count;
+
+    memcpy(prev_plan, layout_plan, sizeof(prev_plan));
+    layout_plan_count = 0;
+    layout_plan_pos = 0;
+    layout_corrupt = false;
+
+    switch (layout_stage) {
+        case LAYOUT_SUPERBLOCK: {
+            uint16_t page_len, pages_per_cluster;
+
+            layout_read_psram(CARD_OFFS_SUPERBLOCK, flushbuf, BLOCK_SIZE);
+            memcpy(&page_len, &flushbuf[0x28], sizeof(page_len));
+            memcpy(&pages_per_cluster, &flushbuf[0x2A], sizeof(pages_per_cluster));
+            memcpy(&layout_alloc_offset, &flushbuf[0x34], sizeof(layout_alloc_offset));
+            memcpy(&layout_rootdir_cluster, &flushbuf[0x3C], sizeof(layout_rootdir_cluster));
+            memcpy(layout_ifc_list, &flushbuf[0x50], sizeof(layout_ifc_list));
+
+            if (memcmp(flushbuf, block0, 28) != 0 || page_len != BLOCK_SIZE || pages_per_cluster == 0 || pages_per_cluster > LOAD_RUN_SECTORS) {
+                log(LOG_WARN, "%s: no valid superblock, loading linearly\n", __func__);
+                layout_stage = LAYOUT_DONE;
+                return;
+            }
+            layout_pages_per_cluster = pages_per_cluster;
+
+            for (size_t i = 0; i < count_of(layout_ifc_list) && layout_ifc_list[i] != 0; i++)
+                if (!layout_plan_cluster(layout_ifc_list[i]))
+                    break;
+            layout_stage = LAYOUT_IFC;
+            break;
+        }
+        case LAYOUT_IFC: {
+            /* every indirect FAT page lists the clusters holding the FAT itself */
+            layout_fat_cluster_count = 0;
+            for (int i = 0; i < prev_plan_count && layout_fat_cluster_count < LAYOUT_MAX_FAT_CLUST; i++) {
+                uint32_t entries[BLOCK_SIZE / 4];
+                layout_read_psram(prev_plan[i] * BLOCK_SIZE, entries, sizeof(entries));
+                for (size_t j = 0; j < count_of(entries) && layout_fat_cluster_count < LAYOUT_MAX_FAT_CLUST; j++) {
+                    if (entries[j] == 0 || entries[j] == 0xFFFFFFFF)
+                        break;
+                    layout_fat_clusters[layout_fat_cluster_count++] = entries[j];
+                }
+            }
+
+            for (int i = 0; i < layout_fat_cluster_count; i++)
+                if (!layout_plan_cluster(layout_fat_clusters[i]))
+                    break;
+            layout_stage = LAYOUT_FAT;
+            break;
+        }
+        case LAYOUT_FAT: {
+            /* follow the root directory's cluster chain */
+            uint32_t cluster = layout_rootdir_cluster;
+            while (layout_plan_cluster(layout_alloc_offset + cluster)) {
+                uint32_t entry = layout_read_fat_entry(cluster);
+                if (!(entry & 0x80000000) || entry == 0xFFFFFFFF)
+                    break;
+                cluster = entry & 0x7FFFFFFF;
+            }
+            layout_stage = LAYOUT_ROOTDIR;
+            break;
+        }
+        case LAYOUT_ROOTDIR: {
+            /* one directory entry per page; the "." entry holds the number of entries */
+            uint32_t entry_count = 0;
+            for (int i = 0; i < prev_plan_count; i++) {
+                layout_read_psram(prev_plan[i] * BLOCK_SIZE, flushbuf, 0x20);
+                if (i == 0)
+                    memcpy(&entry_count, &flushbuf[0x04], sizeof(entry_count));
+                if (i < 2 || (uint32_t)i >= entry_count)
+                    continue;
+
+                uint16_t mode;
+                uint32_t cluster;
+                memcpy(&mode, &flushbuf[0x00], sizeof(mode));
+                memcpy(&cluster, &flushbuf[0x10], sizeof(cluster));
+                /* existing subdirectories, these are what mcman scans next */
+                if ((mode & 0x8000) && (mode & 0x0020))
+                    if (!layout_plan_cluster(layout_alloc_offset + cluster))
+                        break;
+            }
+            layout_stage = LAYOUT_SUBDIRS;
+            break;
+        }
+        default:
+            layout_stage = LAYOUT_DONE;
+            break;
+    }
+
+    if (layout_corrupt) {
+        log(LOG_WARN, "%s: cluster out of range, loading linearly\n", __func__);
+        layout_plan_count = 0;
+        layout_stage = LAYOUT_DONE;
+        return;
+    }
+
+    log(LOG_TRACE, "%s: stage %d, %d sectors planned\n", __func__, layout_stage, layout_plan_count);
+}
+
+static int layout_next_sector(void) {
+    while (layout_stage != LAYOUT_DONE) {
+        for (; layout_plan_pos < layout_plan_count; layout_plan_pos++)
+            if (sector_needs_load(layout_plan[layout_plan_pos]))
+                return layout_plan[layout_plan_pos];
+
+        /* the next stage can only be planned once this one has fully arrived in PSRAM */
+        for (int i = 0; i < layout_plan_count; i++)
+            if (!ps2_cardman_is_sector_available(layout_plan[i]))
+                return -1;
+
+        layout_advance();
+    }
+
+    return -1;
+}
+#endif
+
+static void finish_create(void) {
+    sd_flush(cardman_fd);
+    raw_setup();
+#if WITH_PSRAM
+    resident_store();
+#endif
+    log(LOG_INFO, "OK!\n");
+
+    cardman_operation = CARDMAN_IDLE;
+    uint64_t end = time_us_64();
+
+    log(LOG_INFO, "took = %.2f s; SD write speed = %.2f kB/s\n", (end - cardprog_start) / 1e6,
+        1000000.0 * card_size / (end - cardprog_start) / 1024);
+    if (cardman_cb)
+        cardman_cb(100, true);
+}
+
+#if WITH_PSRAM
+/*
+ * one sector at a time from a stream kept open across runs, so a sector core1 queues meanwhile waits for one
+ * sector and not for the rest of the run; returns the sectors read, the rest of the run is picked up again later
+ */
+static int read_run_raw(int sector, uint8_t *buf, int count) {
+    int done = 0;
+    int ret;
+
+    if (sd_xfer_start(raw_first_sector + sector, buf, count, false) != 0)
+        return -1;
+
+    do {
+        if ((ret = sd_xfer_step()) < 0)
+            return -1;
+        done++;
+    } while ((ret > 0) && (priority_head == priority_tail));
+
+    return done;
+}
+
+static void write_back_run(uint8_t *buf, int count) {
+    /* the dirty task may have moved the file position in between */
+    if (sd_seek(cardman_fd, cardman_sectors_done * BLOCK_SIZE, 0) != 0)
+        fatal(ERR_CARDMAN, "cannot init memcard\nseek");
+
+    if (sd_write(cardman_fd, buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
+        fatal(ERR_CARDMAN, "cannot init memcard");
+
+    cardman_sectors_done += count;
+    cardprog_pos = cardman_sectors_done * BLOCK_SIZE;
+
+    if (cardman_cb)
+        cardman_cb(100U * (uint64_t)cardprog_pos / (uint64_t)card_size, false);
+}
+#endif
+
 static void ps2_cardman_continue(void) {
     if (cardman_operation == CARDMAN_OPEN) {
         uint64_t slice_start = time_us_64();
@@ -413,14 +1181,21 @@ static void ps2_cardman_continue(void) {
         } else {
 #if WITH_PSRAM
             uint8_t thisIter = 0;
+            int load_buf_idx = 0;
             log(LOG_TRACE, "%s:%u\n", __func__, __LINE__);
             while ((ps2_mmceman_fs_idle()) && (time_us_64() - slice_start < MAX_SLICE_LENGTH)) {
                 log(LOG_TRACE, "Slice!\n");
 
-                ps2_dirty_lock();
-                int sector_idx = next_sector_to_load();
-                if (sector_idx == -1) {
-                    ps2_dirty_unlock();
+                int first_sector;
+                int count = next_run_to_load(&first_sector);
+                if (count == 0) {
+                    /* what is left may be the run still in flight */
+                    if (chain.next < chain.count) {
+                        chain_wait();
+                        continue;
+                    }
+                    sparse_map_store();
+                    resident_store();
                     cardman_operation = CARDMAN_IDLE;
                     uint64_t end = time_us_64();
                     log(LOG_INFO, "took = %.2f s; SD read speed = %.2f kB/s\n", (end - cardprog_start) / 1e6,
@@ -430,29 +1205,38 @@ static void ps2_cardman_continue(void) {
                     break;
                 }
 
-                size_t pos = sector_idx * BLOCK_SIZE;
-                if (sd_seek(cardman_fd, pos, 0) != 0)
-                    fatal(ERR_CARDMAN, "cannot read memcard\nseek");
-
-                if (sd_read(cardman_fd, flushbuf, BLOCK_SIZE) != BLOCK_SIZE)
-                    fatal(ERR_CARDMAN, "cannot read memcard\nread %u", pos);
-
-                log(LOG_TRACE, "Writing pos %u\n", pos);
-                psram_write_dma(pos, flushbuf, BLOCK_SIZE, NULL);
-
-                psram_wait_for_dma();
-
-                ps2_cardman_mark_sector_available(sector_idx);
-                ps2_dirty_unlock();
+                /* the previous run goes to PSRAM from the other buffer meanwhile */
+                uint8_t *buf = load_buf[load_buf_idx];
+                load_buf_idx ^= 1;
+
+                size_t pos = first_sector * BLOCK_SIZE;
+                if (sector_is_erased(first_sector)) {
+                    memset(buf, 0xFF, count * BLOCK_SIZE);
+                } else {
+                    if (raw_in_card(first_sector, count))
+                        count = read_run_raw(first_sector, buf, count);
+                    else if (read_sectors(first_sector, buf, count) != 0)
+                        count = -1;
+                    if (count < 0)
+                        fatal(ERR_CARDMAN, "cannot read memcard\nread %u", pos);
+
+                    sparse_map_scan(first_sector, count, buf);
+                }
 
+                log(LOG_TRACE, "Writing pos %u, %d sectors\n", pos, count);
+                chain_wait();
+                chain_start(true, buf, first_sector, count);
+                cardman_sectors_done += count;
                 cardprog_pos = cardman_sectors_done * BLOCK_SIZE;
 
                 if (cardman_cb)
                     cardman_cb(100U * (uint64_t)cardprog_pos / (uint64_t)card_size, false);
 
-                cardman_sectors_done++;
                 thisIter++;
             }
+            /* other core0 PSRAM users never find a run in flight */
+            chain_wait();
+            sd_xfer_stop();
             log(LOG_INFO, "ps2_cardman_continue: thisIter = %u\n", thisIter);
             log(LOG_TRACE, "%s:%u\n", __func__, __LINE__);
 
@@ -460,45 +1244,53 @@ static void ps2_cardman_continue(void) {
         }
     } else if (cardman_operation == CARDMAN_CREATE) {
         uint64_t slice_start = time_us_64();
-        while ((ps2_mmceman_fs_idle()) && (time_us_64() - slice_start < MAX_SLICE_LENGTH)) {
-            cardprog_pos = cardman_sectors_done * BLOCK_SIZE;
-            if (cardprog_pos >= card_size) {
-                sd_flush(cardman_fd);
-                log(LOG_INFO, "OK!\n");
-
-                cardman_operation = CARDMAN_IDLE;
-                uint64_t end = time_us_64();
+        if (ps2_mc_data_interface_get_sdmode()) {
+            while ((ps2_mmceman_fs_idle()) && (time_us_64() - slice_start < MAX_SLICE_LENGTH)) {
+                cardprog_pos = cardman_sectors_done * BLOCK_SIZE;
+                if (cardprog_pos >= card_size) {
+                    finish_create();
+                    break;
+                }
+                int count = MIN(CREATE_RUN_SECTORS, sector_count - cardman_sectors_done);
+                for (int i = 0; i < count; i++)
+                    genblock(cardprog_pos + i * BLOCK_SIZE, &create_buf[i * BLOCK_SIZE]);
+                if (sd_write(cardman_fd, create_buf, count * BLOCK_SIZE) != count * BLOCK_SIZE)
+                    fatal(ERR_CARDMAN, "cannot init memcard");
 
-                log(LOG_INFO, "took = %.2f s; SD write speed = %.2f kB/s\n", (end - cardprog_start) / 1e6,
-                    1000000.0 * card_size / (end - cardprog_start) / 1024);
                 if (cardman_cb)
-                    cardman_cb(100, true);
+                    cardman_cb(100U * (uint64_t)cardprog_pos / (uint64_t)card_size, cardman_operation == CARDMAN_IDLE);
 
-                break;
+                cardman_sectors_done += count;
             }
-            if (ps2_mc_data_interface_get_sdmode()) {
-                genblock(cardprog_pos, flushbuf);
-                sd_write(cardman_fd, flushbuf, BLOCK_SIZE);
-            } else {
+        } else {
 #if WITH_PSRAM
-                ps2_dirty_lock();
-                psram_wait_for_dma();
-
+            int buf_idx = 0;
+            int count = 0;  // sectors read back into load_buf[buf_idx]
+            while ((ps2_mmceman_fs_idle()) && (time_us_64() - slice_start < MAX_SLICE_LENGTH)) {
                 // read back from PSRAM to make sure to retain already rewritten sectors, if any
-                psram_read_dma(cardprog_pos, flushbuf, BLOCK_SIZE, NULL);
-                psram_wait_for_dma();
+                if (count == 0) {
+                    count = MIN(LOAD_RUN_SECTORS, sector_count - cardman_sectors_done);
+                    if (count == 0) {
+                        finish_create();
+                        break;
+                    }
+                    chain_start(false, load_buf[buf_idx], cardman_sectors_done, count);
+                }
+                chain_wait();
 
-                if (sd_write(cardman_fd, flushbuf, BLOCK_SIZE) != BLOCK_SIZE)
-                    fatal(ERR_CARDMAN, "cannot init memcard");
+                /* the next run is read back into the other buffer while this one is written to SD */
+                uint8_t *buf = load_buf[buf_idx];
+                buf_idx ^= 1;
+                int next_count = MIN(LOAD_RUN_SECTORS, sector_count - cardman_sectors_done - count);
+                if (next_count > 0)
+                    chain_start(false, load_buf[buf_idx], cardman_sectors_done + count, next_count);
 
-                ps2_dirty_unlock();
-#endif
+                write_back_run(buf, count);
+                count = next_count;
             }
-
-            if (cardman_cb)
-                cardman_cb(100U * (uint64_t)cardprog_pos / (uint64_t)card_size, cardman_operation == CARDMAN_IDLE);
-
-            cardman_sectors_done++;
+            /* a run read ahead is dropped, the dirty task may flush newer data for it before the next slice */
+            chain_wait();
+#endif
         }
         sd_flush(cardman_fd);
 
@@ -507,6 +1299,110 @@ static void ps2_cardman_continue(void) {
     }
 }
 
+#if WITH_PSRAM
+static void preload_cancel(void) {
+    preload_armed = false;
+    if (preload_fd >= 0) {
+        log(LOG_INFO, "%s: %s\n", __func__, preload_path);
+        sd_close(preload_fd);
+        preload_fd = -1;
+    }
+}
+
+/*
+ * a game started from the boot card switches to its game ID card, and leaving the game goes back to the boot card;
+ * otherwise the next channel of the open card is the usual next step
+ */
+static bool preload_predict(void) {
+    uint8_t max_chan = card_config_get_max_channels(folder_name, (cardman_state == PS2_CM_STATE_BOOT) ? "BootCard" : folder_name);
+    int chan = card_chan + 1;
+
+    if ((cardman_state == PS2_CM_STATE_BOOT) && settings_get_ps2_game_id() && preload_gameid_folder[0]) {
+        snprintf(preload_path, sizeof(preload_path), "%s/%s/%s-%d.mcd", cardhome, preload_gameid_folder, preload_gameid_folder,
+                 CHAN_MIN);
+        return true;
+    }
+    if ((cardman_state == PS2_CM_STATE_GAMEID) && settings_get_ps2_autoboot()) {
+        snprintf(preload_path, sizeof(preload_path), "%s/BOOT/BootCard-%d.mcd", cardhome, settings_get_ps2_boot_channel());
+        return true;
+    }
+
+    if (chan > max_chan)
+        return false;
+
+    if (cardman_state == PS2_CM_STATE_BOOT)
+        snprintf(preload_path, sizeof(preload_path), "%s/%s/BootCard-%d.mcd", cardhome, folder_name, chan);
+    else
+        snprintf(preload_path, sizeof(preload_path), "%s/%s/%s-%d.mcd", cardhome, folder_name, folder_name, chan);
+    return true;
+}
+
+static void preload_start(void) {
+    uint32_t size;
+
+    preload_armed = false;
+    if (!preload_predict() || !sd_exists(preload_path) || (preload_fd = sd_open(preload_path, O_RDONLY)) < 0)
+        return;
+
+    size = sd_filesize(preload_fd);
+    if ((size < PS2_CARD_SIZE_512K) || (size > PS2_CARD_SIZE_8M) || (size & (size - 1))
+        || !card_fingerprint(fingerprint_read_file, &preload_fd, size, &preload_fingerprint)
+        || (resident_find(preload_path, size, &preload_fingerprint) >= 0)
+        || ((preload_slot = resident_pick()) < 0)) {
+        sd_close(preload_fd);
+        preload_fd = -1;
+        return;
+    }
+
+    resident_cards[preload_slot].valid = false;
+    preload_sector = 0;
+    preload_sector_count = size / BLOCK_SIZE;
+    log(LOG_INFO, "%s: %s into region %d\n", __func__, preload_path, preload_slot);
+}
+
+/* one run per call, and only while neither the console nor MMCE is using the card */
+static void preload_continue(void) {
+    if ((cardman_operation != CARDMAN_IDLE) || ps2_mc_data_interface_get_sdmode() || !ps2_mmceman_fs_idle()
+        || ps2_dirty_activity || !ps2_dirty_lockout_expired())
+        return;
+
+    if (preload_fd < 0) {
+        if (preload_armed)
+            preload_start();
+        return;
+    }
+
+    int count = MIN(LOAD_RUN_SECTORS, preload_sector_count - preload_sector);
+    if ((sd_seek(preload_fd, preload_sector * BLOCK_SIZE, 0) != 0)
+        || (sd_read(preload_fd, load_buf[0], count * BLOCK_SIZE) != count * BLOCK_SIZE)) {
+        preload_cancel();
+        return;
+    }
+
+    /* one sector per lock, the same as core1 is used to */
+    for (int i = 0; i < count; i++) {
+        ps2_dirty_lock();
+        psram_write_dma((uint32_t)preload_slot * PS2_CARD_SIZE_8M + (preload_sector + i) * BLOCK_SIZE,
+                        &load_buf[0][i * BLOCK_SIZE], BLOCK_SIZE, NULL);
+        psram_wait_for_dma();
+        ps2_dirty_unlock();
+    }
+    preload_sector += count;
+
+    if (preload_sector >= preload_sector_count) {
+        resident_card_t *card = &resident_cards[preload_slot];
+
+        snprintf(card->path, sizeof(card->path), "%s", preload_path);
+        card->card_size = preload_sector_count * BLOCK_SIZE;
+        card->fingerprint = preload_fingerprint;
+        card->last_use = ++resident_tick;
+        card->valid = true;
+        log(LOG_INFO, "%s: %s is resident in region %d\n", __func__, preload_path, preload_slot);
+        preload_cancel();
+    }
+}
+#endif
+
 void ps2_cardman_open(void) {
     char path[256];
 
@@ -546,6 +1442,14 @@ void ps2_cardman_open(void) {
 
     log(LOG_INFO, "Switching to card path = %s\n", path);
     ps2_mc_data_interface_card_changed();
+    snprintf(opened_path, sizeof(opened_path), "%s", path);
+#if WITH_PSRAM
+    preload_cancel();
+    preload_armed = (resident_card_count > 1);
+    if (cardman_state == PS2_CM_STATE_GAMEID)
+        snprintf(preload_gameid_folder, sizeof(preload_gameid_folder), "%s", folder_name);
+    resident_slot = -1;
+#endif
 
     if (!sd_exists(path)) {
         card_size = card_config_get_ps2_cardsize(folder_name, (cardman_state == PS2_CM_STATE_BOOT) ? "BootCard" : folder_name) * 1024 * 1024;
@@ -565,25 +1469,40 @@ void ps2_cardman_open(void) {
         if (cardman_fd < 0)
             fatal(ERR_CARDMAN, "cannot open for creating new card");
 
+        /* one contiguous extent lets sector I/O bypass the FAT once the image is filled */
+        if (sd_preallocate(cardman_fd, card_size) != 0)
+            log(LOG_WARN, "%s: cannot preallocate %s contiguously\n", __func__, path);
+
+        /* the map is rebuilt on the first full load of the new image */
+        ps2_cardman_forget_sparse_map(path);
+
         log(LOG_INFO, "create new image at %s... ", path);
 
         if (cardman_cb)
             cardman_cb(0, false);
 #if WITH_PSRAM
         if (card_size <= PS2_CARD_SIZE_8M) {
-            // quickly generate and write an empty card into PSRAM so that it's immediately available, takes about ~0.6s
-            for (size_t pos = 0; pos < card_size; pos += BLOCK_SIZE) {
-                if (card_size == PS2_CARD_SIZE_8M)
-                    genblock(pos, flushbuf);
-                else
-                    memset(flushbuf, 0xFF, BLOCK_SIZE);
-
-                ps2_dirty_lock();
-                psram_write_dma(pos, flushbuf, BLOCK_SIZE, NULL);
-                psram_wait_for_dma();
-                ps2_cardman_mark_sector_available(pos / BLOCK_SIZE);
-                ps2_dirty_unlock();
+            resident_select(resident_pick(), false);
+
+            // quickly generate and write an empty card into PSRAM so that it's immediately available
+            for (int first_sector = 0; first_sector < (int)(card_size / BLOCK_SIZE); first_sector += LOAD_RUN_SECTORS) {
+                /* the previous run goes to PSRAM from the other buffer meanwhile */
+                uint8_t *buf = load_buf[(first_sector / LOAD_RUN_SECTORS) & 1];
+                for (int i = 0; i < LOAD_RUN_SECTORS; i++) {
+                    if (card_size == PS2_CARD_SIZE_8M)
+                        genblock((first_sector + i) * BLOCK_SIZE, &buf[i * BLOCK_SIZE]);
+                    else
+                        memset(&buf[i * BLOCK_SIZE], 0xFF, BLOCK_SIZE);
+                }
+
+                chain_wait();
+                chain_start(true, buf, first_sector, LOAD_RUN_SECTORS);
             }
+            chain_wait();
+
+            /* progress of the create operation counts sectors written to SD */
+            cardman_sectors_done = 0;
+            cardprog_pos = 0;
             log(LOG_TRACE, "%s created empty PSRAM image... \n", __func__);
         }
 #endif
@@ -611,6 +1530,29 @@ void ps2_cardman_open(void) {
             default: fatal(ERR_CARDMAN, "Card %d Chann %d invalid size", card_idx, card_chan); break;
         }
 
+        raw_setup();
+
+#if WITH_PSRAM
+        layout_reset();
+        /* the content key is read from SD before anything of the image is trusted */
+        uint64_t fingerprint;
+        bool fingerprinted = !ps2_mc_data_interface_get_sdmode()
+            && card_fingerprint(fingerprint_read_file, &cardman_fd, card_size, &fingerprint);
+        sparse_map_open(path, fingerprinted ? &fingerprint : NULL);
+
+        if (!ps2_mc_data_interface_get_sdmode()) {
+            int slot = resident_find(path, card_size, fingerprinted ? &fingerprint : NULL);
+            resident_select((slot >= 0) ? slot : resident_pick(), slot >= 0);
+            if (slot >= 0) {
+                /* image is still in PSRAM, unchanged on SD since */
+                log(LOG_INFO, "%s: %s is resident in region %d\n", __func__, path, slot);
+                layout_stage = LAYOUT_DONE;
+                memset(available_sectors, 0xFF, sizeof(available_sectors));
+                cardman_operation = CARDMAN_IDLE;
+            }
+        }
+#endif
+
         /* read 8 megs of card image */
         log(LOG_INFO, "reading card (%lu KB).... ", (uint32_t)(card_size / 1024));
         cardprog_start = time_us_64();
@@ -627,11 +1569,31 @@ void ps2_cardman_close(void) {
     if (cardman_fd < 0)
         return;
     ps2_cardman_flush();
+#if WITH_PSRAM
+    preload_cancel();
+    /* flushed writes may have moved the FAT, so the content key is taken again; writes not flushed yet would be
+     * lost on a resident reopen */
+    if ((resident_slot >= 0) && resident_cards[resident_slot].valid) {
+        if (ps2_dirty_activity)
+            resident_cards[resident_slot].valid = false;
+        else
+            resident_store();
+    }
+    resident_slot = -1;
+    /* a map still being built by the load is incomplete */
+    if (sparse_map_trusted)
+        sparse_map_store();
+#endif
     sd_close(cardman_fd);
     cardman_fd = -1;
+    raw_first_sector = 0;
     current_read_sector = 0;
-    priority_sector = -1;
 #if WITH_PSRAM
+    priority_head = priority_tail = 0;
+    layout_stage = LAYOUT_DONE;
+    sparse_map_active = false;
+    sparse_map_trusted = false;
+    sparse_map_dirty = false;
     memset(available_sectors, 0, sizeof(available_sectors));
 #endif
 }
@@ -829,6 +1791,11 @@ bool ps2_cardman_is_idle(void) {
 
 void ps2_cardman_init(void) {
     card_variant = settings_get_ps2_variant();
+#if WITH_PSRAM
+    /* PS1 mode reuses PSRAM */
+    memset(resident_cards, 0, sizeof(resident_cards));
+    resident_card_count = MAX(1, MIN(RESIDENT_CARD_MAX, (int)(psram_size() / PS2_CARD_SIZE_8M)));
+#endif
     if (!try_set_boot_card())
         set_default_card();
 
@@ -837,4 +1804,7 @@ void ps2_cardman_init(void) {
 
 void ps2_cardman_task(void) {
     ps2_cardman_continue();
+#if WITH_PSRAM
+    preload_continue();
+#endif
 }
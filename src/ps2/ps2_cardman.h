@@ -25,15 +25,19 @@ typedef enum  {
 } ps2_cardman_state_t;
 
 extern int cardman_fd;
+/* PSRAM address of the open card image */
+extern volatile uint32_t ps2_cardman_psram_base;
 
 void ps2_cardman_init(void);
 void ps2_cardman_task(void);
 int ps2_cardman_read_sector(int sector, void *buf512);
 int ps2_cardman_write_sector(int sector, void *buf512);
+int ps2_cardman_write_sectors(int sector, int count, void *buf);
 bool ps2_cardman_is_sector_available(int sector);
 void ps2_cardman_mark_sector_available(int sector);
 void ps2_cardman_set_priority_sector(int page_idx);
 void ps2_cardman_flush(void);
+void ps2_cardman_forget_sparse_map(const char *card_path);
 void ps2_cardman_open(void);
 void ps2_cardman_close(void);
 int ps2_cardman_get_idx(void);
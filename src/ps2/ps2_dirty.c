@@ -18,6 +18,9 @@ int ps2_dirty_activity = 0;
 
 static int num_dirty;
 
+/* longest run of consecutive sectors written back with a single seek */
+#define DIRTY_RUN_SECTORS 16
+
 #define SWAP(a, b) do { \
     uint16_t tmp = a; \
     a = b; \
@@ -90,9 +93,25 @@ int ps2_dirty_get_marked(void) {
     return ret;
 }
 
+/* pops the lowest dirty sector together with the dirty sectors directly following it */
+static int ps2_dirty_get_run(int *sector, int max) {
+    int count = 1;
+
+    *sector = ps2_dirty_get_marked();
+    if (*sector == -1)
+        return 0;
+
+    while (count < max && num_dirty > 0 && dirty_heap[0] == *sector + count) {
+        ps2_dirty_get_marked();
+        ++count;
+    }
+
+    return count;
+}
+
 /* this goes through blocks in psram marked as dirty and flushes them to sd */
 void ps2_dirty_task(void) {
-    static uint8_t flushbuf[512];
+    static uint8_t flushbuf[DIRTY_RUN_SECTORS * 512];
 
     int num_after = 0;
     int hit = 0;
@@ -104,30 +123,37 @@ void ps2_dirty_task(void) {
         if ((time_us_64() - start) > 100 * 1000)
             break;
 
+        int sector;
         ps2_dirty_lock();
-        int sector = ps2_dirty_get_marked();
+        int count = ps2_dirty_get_run(&sector, DIRTY_RUN_SECTORS);
         num_after = num_dirty;
-        if (sector == -1) {
-            ps2_dirty_unlock();
+        ps2_dirty_unlock();
+        if (count == 0)
             break;
+
+        /* one sector per lock so core1 is never held off longer than before */
+        for (int i = 0; i < count; ++i) {
+            ps2_dirty_lock();
+            psram_read_dma(ps2_cardman_psram_base + (sector + i) * 512, &flushbuf[i * 512], 512, NULL);
+            psram_wait_for_dma();
+            ps2_dirty_unlock();
         }
-        psram_read_dma(sector * 512, flushbuf, 512, NULL);
-        psram_wait_for_dma();
-        ps2_dirty_unlock();
 
-        ++hit;
+        hit += count;
 
-        if (ps2_cardman_write_sector(sector, flushbuf) != 0) {
+        if (ps2_cardman_write_sectors(sector, count, flushbuf) != 0) {
             // TODO: do something if we get too many errors?
             // for now lets push it back into the heap and try again later
-            DPRINTF("!! writing sector 0x%x failed\n", sector);
+            DPRINTF("!! writing sectors 0x%x-0x%x failed\n", sector, sector + count - 1);
 
             ps2_dirty_lock();
-            ps2_dirty_mark(sector);
+            for (int i = 0; i < count; ++i)
+                ps2_dirty_mark(sector + i);
             ps2_dirty_unlock();
         }
-        //DPRINTF("Writing %u\n", sector);
-        ps2_history_tracker_registerPageWrite(sector);
+        //DPRINTF("Writing %u+%u\n", sector, count);
+        for (int i = 0; i < count; ++i)
+            ps2_history_tracker_registerPageWrite(sector + i);
     }
     /* to make sure writes hit the storage medium */
     ps2_cardman_flush();
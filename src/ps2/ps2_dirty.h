@@ -14,6 +14,15 @@ static inline void __time_critical_func(ps2_dirty_lock)(void) {
     spin_lock_unsafe_blocking(ps2_dirty_spin_lock);
 }
 
+/* reading a hardware spin lock claims it if it is free; for irq handlers, which must not spin on a lock the
+ * interrupted code may hold */
+static inline bool __time_critical_func(ps2_dirty_try_lock)(void) {
+    if (!*ps2_dirty_spin_lock)
+        return false;
+    __mem_fence_acquire();
+    return true;
+}
+
 static inline void __time_critical_func(ps2_dirty_unlock)(void) {
     spin_unlock_unsafe(ps2_dirty_spin_lock);
 }
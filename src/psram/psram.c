@@ -19,6 +19,7 @@ static pio_spi_inst_t spi = {
 };
 
 static critical_section_t crit_psram;
+static uint32_t detected_size = 8 * 1024 * 1024;
 
 
 #define SPI_OP(stmt) \
@@ -142,6 +143,28 @@ static void psram_run_tests(void) {
         1000000.0 * (NUM_TESTS * TEST_CYCLES * TEST_BLOCK_SIZE * 2) / (end - start) / 1024);
 }
 
+/* a smaller chip ignores the upper address bits, so a marker written at 8 MB shows up at 0 */
+static void psram_detect_size(void) {
+    uint32_t low = 0x5A5AA5A5, high = 0xC3C33C3C, check_low = 0, check_high = 0;
+
+    psram_write_dma(0, &low, sizeof(low), NULL);
+    psram_wait_for_dma();
+    psram_write_dma(8 * 1024 * 1024, &high, sizeof(high), NULL);
+    psram_wait_for_dma();
+
+    psram_read_dma(0, &check_low, sizeof(check_low), NULL);
+    psram_wait_for_dma();
+    psram_read_dma(8 * 1024 * 1024, &check_high, sizeof(check_high), NULL);
+    psram_wait_for_dma();
+
+    detected_size = ((check_low == low) && (check_high == high)) ? PSRAM_MAX_SIZE : 8 * 1024 * 1024;
+    printf("PSRAM size %u MB\n", (unsigned)(detected_size / (1024 * 1024)));
+}
+
+uint32_t psram_size(void) {
+    return detected_size;
+}
+
 void psram_init(void) {
     uint32_t offset;
 
@@ -177,11 +200,12 @@ void psram_init(void) {
 
     /* validate PSRAM is working properly */
     psram_run_tests();
+    psram_detect_size();
 
     /* and erase everything to 0xFF */
     uint8_t erasebuf[512];
     memset(erasebuf, 0xFF, sizeof(erasebuf));
-    for (int i = 0; i < 8 * 1024 * 1024; i += 512) {
+    for (uint32_t i = 0; i < detected_size; i += 512) {
         psram_write_dma(i, erasebuf, sizeof(erasebuf), NULL);
         psram_wait_for_dma();
     }
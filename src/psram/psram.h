@@ -3,7 +3,11 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+/* the QSPI commands carry 24 bit addresses */
+#define PSRAM_MAX_SIZE (16 * 1024 * 1024)
+
 void psram_init(void);
+uint32_t psram_size(void);
 void psram_read(uint32_t addr, void *buf, size_t sz);
 void psram_write(uint32_t addr, void *buf, size_t sz);
 void psram_read_dma(uint32_t addr, void *buf, size_t sz, void (*cb)(void));
@@ -0,0 +1,125 @@
+/*
+ * Host stress test for the PS2 data interface op ring: one producer and one consumer thread hammer a
+ * small ring and the consumer checks that every entry arrives exactly once and in order.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ps2_mc_op_ring.h"
+
+#define ITEMS (200 * 1000)
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check;     // second word, catches entries read before they were fully written
+} entry_t;
+
+typedef struct {
+    ps2_mc_op_ring_t ring;
+    uint32_t size;
+    entry_t* entries;
+    uint32_t errors;
+} test_ring_t;
+
+static uint32_t mix(uint32_t seq) {
+    return seq * 2654435761u ^ 0x5A5A5A5Au;
+}
+
+static void* producer(void* arg) {
+    test_ring_t* t = arg;
+
+    for (uint32_t seq = 0; seq < ITEMS; seq++) {
+        int slot;
+        while ((slot = ps2_mc_op_ring_push_slot(&t->ring, t->size)) < 0)
+            sched_yield();
+        t->entries[slot].seq = seq;
+        t->entries[slot].check = mix(seq);
+        ps2_mc_op_ring_push_commit(&t->ring, t->size);
+    }
+    return NULL;
+}
+
+static void* consumer(void* arg) {
+    test_ring_t* t = arg;
+
+    for (uint32_t expected = 0; expected < ITEMS; expected++) {
+        int slot;
+        while ((slot = ps2_mc_op_ring_pop_slot(&t->ring, t->size)) < 0)
+            sched_yield();
+        entry_t e = t->entries[slot];
+        if (e.seq != expected || e.check != mix(expected)) {
+            if (t->errors++ < 10)
+                fprintf(stderr, "size %u: got %u (check %08x), expected %u\n", t->size, e.seq, e.check, expected);
+        }
+        ps2_mc_op_ring_pop_commit(&t->ring, t->size);
+    }
+    return NULL;
+}
+
+static int stress(uint32_t size) {
+    test_ring_t t = { .size = size };
+    pthread_t prod, cons;
+
+    t.entries = calloc(size, sizeof(entry_t));
+    ps2_mc_op_ring_reset(&t.ring);
+
+    pthread_create(&cons, NULL, consumer, &t);
+    pthread_create(&prod, NULL, producer, &t);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    if (ps2_mc_op_ring_fill(&t.ring, size) != 0) {
+        fprintf(stderr, "size %u: ring not empty at the end\n", size);
+        t.errors++;
+    }
+    free(t.entries);
+
+    printf("size %u: %u items, %u errors\n", size, ITEMS, t.errors);
+    return t.errors != 0;
+}
+
+/* single threaded: full and empty are told apart at every position of the indices */
+static int bounds(uint32_t size) {
+    ps2_mc_op_ring_t ring;
+    int errors = 0;
+
+    ps2_mc_op_ring_reset(&ring);
+    for (uint32_t round = 0; round < 4 * size + 3; round++) {
+        for (uint32_t i = 0; i < size; i++) {
+            if (ps2_mc_op_ring_push_slot(&ring, size) < 0)
+                errors++;
+            ps2_mc_op_ring_push_commit(&ring, size);
+        }
+        if (ps2_mc_op_ring_push_slot(&ring, size) >= 0 || ps2_mc_op_ring_fill(&ring, size) != size)
+            errors++;
+        for (uint32_t i = 0; i < size; i++) {
+            if (ps2_mc_op_ring_pop_slot(&ring, size) < 0)
+                errors++;
+            ps2_mc_op_ring_pop_commit(&ring, size);
+        }
+        if (ps2_mc_op_ring_pop_slot(&ring, size) >= 0 || ps2_mc_op_ring_fill(&ring, size) != 0)
+            errors++;
+
+        /* shift the start position for the next round */
+        ps2_mc_op_ring_push_commit(&ring, size);
+        ps2_mc_op_ring_pop_commit(&ring, size);
+    }
+
+    printf("size %u: bounds, %d errors\n", size, errors);
+    return errors != 0;
+}
+
+int main(void) {
+    static const uint32_t sizes[] = { 1, 2, 3, 37 };
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        failed |= bounds(sizes[i]);
+        failed |= stress(sizes[i]);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}